@@ -0,0 +1,447 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "analyzer.h"
+
+#include "deal.h"
+#include "engine.h"
+#include "history.h"
+#include "solver.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+// Range of seed offsets owned by a worker. Begin and end are packed in one
+// word, so that the owner taking seeds from the front and thieves taking the
+// back half are both a single compare and swap.
+class alignas( 64 ) WorkRange
+{
+public:
+    void assign( uint32_t begin, uint32_t end )
+    {
+        m_bounds.store( pack( begin, end ), std::memory_order_release );
+    }
+
+    // Takes up to n seeds from the front
+    bool take( uint32_t n, uint32_t &begin, uint32_t &end )
+    {
+        uint64_t cur = m_bounds.load( std::memory_order_acquire );
+        while ( true )
+        {
+            uint32_t b = cur, e = cur >> 32;
+            if ( b >= e )
+            {
+                return false;
+            }
+
+            begin = b;
+            end = std::min( e, b + n );
+            if ( m_bounds.compare_exchange_weak( cur, pack( end, e ), std::memory_order_acq_rel ) )
+            {
+                return true;
+            }
+        }
+    }
+
+    // Takes the back half, if there is anything worth taking
+    bool steal( uint32_t &begin, uint32_t &end )
+    {
+        uint64_t cur = m_bounds.load( std::memory_order_acquire );
+        while ( true )
+        {
+            uint32_t b = cur, e = cur >> 32;
+            if ( e <= b + 1 )
+            {
+                return false;
+            }
+
+            uint32_t mid = b + ( e - b ) / 2;
+            if ( m_bounds.compare_exchange_weak( cur, pack( b, mid ), std::memory_order_acq_rel ) )
+            {
+                begin = mid;
+                end = e;
+                return true;
+            }
+        }
+    }
+
+    uint32_t remaining() const
+    {
+        uint64_t cur = m_bounds.load( std::memory_order_relaxed );
+        uint32_t b = cur, e = cur >> 32;
+        return e > b ? e - b : 0;
+    }
+
+private:
+    static uint64_t pack( uint32_t begin, uint32_t end )
+    {
+        return static_cast< uint64_t >( end ) << 32 | begin;
+    }
+
+    std::atomic< uint64_t > m_bounds{ 0 };
+};
+
+struct SeedResult
+{
+    uint64_t seed;
+    SolveStatus status;
+    uint32_t moves;
+    uint64_t expanded;
+    uint64_t micros;
+    std::vector< uint16_t > solution; // Only with AnalyzeOptions::moves
+};
+
+// Seeds taken at once by a worker, dealt together
+const int chunk_size = 8;
+
+const char* to_str( SolveStatus s )
+{
+    switch ( s )
+    {
+    case SolveStatus::Solved:       return "solved";
+    case SolveStatus::Unsolvable:   return "unsolvable";
+    case SolveStatus::LimitReached: return "unknown";
+    }
+    return "?";
+}
+
+// Checkpoint layout: header, followed by one bit per seed in range
+struct CheckpointHeader
+{
+    char magic[ 8 ];
+    uint64_t from;
+    uint64_t to;
+    uint64_t ms_deals;
+    uint64_t moves;
+    uint64_t output_size; // Output is truncated to this size when resuming
+};
+
+const char checkpoint_magic[ 8 ] = { 'F', 'C', 'A', 'N', 'L', 'Z', '0', '2' };
+
+// Collects finished results, writes them out and checkpoints periodically.
+// Shared by all workers behind a mutex, which is taken once per batch.
+class ResultWriter
+{
+public:
+    ResultWriter( const AnalyzeOptions &opts, FILE *out, std::vector< uint8_t > done )
+        : m_opts( opts )
+        , m_out( out )
+        , m_done( std::move( done ) )
+        , m_last_checkpoint( std::chrono::steady_clock::now() )
+    {}
+
+    void write( const std::vector< SeedResult > &results )
+    {
+        std::lock_guard< std::mutex > lock( m_mutex );
+
+        for ( const SeedResult &r : results )
+        {
+            fprintf( m_out, "%" PRIu64 " %s %" PRIu32 " %" PRIu64 " %" PRIu64,
+                     r.seed, to_str( r.status ), r.moves, r.expanded, r.micros );
+            if ( ! r.solution.empty() )
+            {
+                fputc( ' ', m_out );
+                for ( uint16_t code : r.solution )
+                {
+                    fprintf( m_out, "%04" PRIx16, code );
+                }
+            }
+            fputc( '\n', m_out );
+
+            uint64_t offset = r.seed - m_opts.from;
+            m_done[ offset / 8 ] |= 1 << ( offset % 8 );
+        }
+        m_finished += results.size();
+
+        auto now = std::chrono::steady_clock::now();
+        if ( now - m_last_checkpoint >= std::chrono::seconds( 10 ) )
+        {
+            checkpoint_locked();
+            m_last_checkpoint = now;
+
+            std::cerr << "Analyzed " << m_finished << " seeds\n";
+        }
+    }
+
+    void checkpoint()
+    {
+        std::lock_guard< std::mutex > lock( m_mutex );
+        checkpoint_locked();
+    }
+
+private:
+    void checkpoint_locked()
+    {
+        fflush( m_out );
+        if ( m_opts.output.empty() )
+        {
+            return;
+        }
+
+        // Results must be on disk before the checkpoint that counts them
+        fsync( fileno( m_out ) );
+
+        CheckpointHeader header;
+        memcpy( header.magic, checkpoint_magic, sizeof( header.magic ) );
+        header.from = m_opts.from;
+        header.to = m_opts.to;
+        header.ms_deals = m_opts.ms_deals;
+        header.moves = m_opts.moves;
+        header.output_size = ftell( m_out );
+
+        std::string path = m_opts.output + ".checkpoint";
+        std::string tmp_path = path + ".tmp";
+
+        FILE *f = fopen( tmp_path.c_str(), "wb" );
+        if ( ! f )
+        {
+            std::cerr << "Cannot write " << tmp_path << "\n";
+            return;
+        }
+        bool ok = fwrite( &header, sizeof( header ), 1, f ) == 1
+               && fwrite( m_done.data(), 1, m_done.size(), f ) == m_done.size();
+        ok = ( fflush( f ) == 0 ) && ok;
+        fsync( fileno( f ) );
+        fclose( f );
+
+        if ( ok )
+        {
+            rename( tmp_path.c_str(), path.c_str() );
+        }
+    }
+
+    const AnalyzeOptions &m_opts;
+    FILE *m_out;
+    std::mutex m_mutex;
+    std::vector< uint8_t > m_done;
+    uint64_t m_finished = 0;
+    std::chrono::steady_clock::time_point m_last_checkpoint;
+};
+
+// Loads done bits and truncates output to match them. Returns false on error.
+bool load_checkpoint( const AnalyzeOptions &opts, std::vector< uint8_t > &done )
+{
+    std::string path = opts.output + ".checkpoint";
+    FILE *f = fopen( path.c_str(), "rb" );
+    if ( ! f )
+    {
+        // Fresh run
+        return truncate( opts.output.c_str(), 0 ) == 0 || errno == ENOENT;
+    }
+
+    CheckpointHeader header;
+    bool ok = fread( &header, sizeof( header ), 1, f ) == 1
+           && memcmp( header.magic, checkpoint_magic, sizeof( header.magic ) ) == 0
+           && fread( done.data(), 1, done.size(), f ) == done.size();
+    fclose( f );
+
+    if ( ! ok )
+    {
+        std::cerr << "Invalid checkpoint file " << path << "\n";
+        return false;
+    }
+
+    if ( header.from != opts.from || header.to != opts.to || header.ms_deals != opts.ms_deals || header.moves != opts.moves )
+    {
+        std::cerr << "Checkpoint " << path << " is for range " << header.from << "-" << header.to
+                  << ( header.ms_deals ? " of Microsoft deals" : "" )
+                  << ( header.moves ? " with moves" : "" ) << "\n";
+        return false;
+    }
+
+    if ( truncate( opts.output.c_str(), header.output_size ) != 0 )
+    {
+        std::cerr << "Cannot truncate " << opts.output << "\n";
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace
+
+int analyze_range( const AnalyzeOptions &opts )
+{
+    // Checked before adding one, which wraps around for the whole range
+    if ( opts.to < opts.from || opts.to - opts.from >= UINT32_MAX )
+    {
+        std::cerr << "Invalid range\n";
+        return 1;
+    }
+    const uint64_t count = opts.to - opts.from + 1;
+
+    std::vector< uint8_t > done( ( count + 7 ) / 8 );
+    FILE *out = stdout;
+    if ( ! opts.output.empty() )
+    {
+        if ( ! load_checkpoint( opts, done ) )
+        {
+            return 1;
+        }
+
+        out = fopen( opts.output.c_str(), "a" );
+        if ( ! out )
+        {
+            std::cerr << "Cannot open " << opts.output << "\n";
+            return 1;
+        }
+        fseek( out, 0, SEEK_END ); // So that ftell reports the size before the first write
+    }
+
+    // Seeds finished by an earlier run, read only from here on
+    const std::vector< uint8_t > resumed = done;
+    auto is_resumed = [ & ]( uint32_t offset )
+    {
+        return resumed[ offset / 8 ] & ( 1 << ( offset % 8 ) );
+    };
+
+    ResultWriter writer( opts, out, std::move( done ) );
+
+    const int num_workers = std::max( 1, opts.threads );
+    std::vector< WorkRange > ranges( num_workers );
+    for ( int i = 0; i < num_workers; ++i )
+    {
+        ranges[ i ].assign( count * i / num_workers, count * ( i + 1 ) / num_workers );
+    }
+
+    auto worker = [ & ]( int self )
+    {
+        Solver solver;
+        std::vector< SeedResult > batch;
+
+        while ( true )
+        {
+            uint32_t begin, end;
+            if ( ! ranges[ self ].take( chunk_size, begin, end ) )
+            {
+                // Steal from the worker with the most left
+                int victim = -1;
+                uint32_t most = 1;
+                for ( int i = 0; i < num_workers; ++i )
+                {
+                    uint32_t rem = ranges[ i ].remaining();
+                    if ( i != self && rem > most )
+                    {
+                        victim = i;
+                        most = rem;
+                    }
+                }
+
+                if ( victim < 0 )
+                {
+                    // Whatever is left is being taken by its owner
+                    break;
+                }
+
+                if ( ranges[ victim ].steal( begin, end ) )
+                {
+                    ranges[ self ].assign( begin, end );
+                }
+                continue;
+            }
+
+            uint64_t seeds[ chunk_size ];
+            size_t num_seeds = 0;
+            for ( uint32_t offset = begin; offset < end; ++offset )
+            {
+                if ( ! is_resumed( offset ) )
+                {
+                    seeds[ num_seeds++ ] = opts.from + offset;
+                }
+            }
+
+            GameState deals[ chunk_size ];
+            if ( opts.ms_deals )
+            {
+                for ( size_t i = 0; i < num_seeds; ++i )
+                {
+                    deal_ms( deals[ i ], seeds[ i ] );
+                }
+            }
+            else
+            {
+                deal_batch( seeds, num_seeds, deals );
+            }
+
+            for ( size_t i = 0; i < num_seeds; ++i )
+            {
+                auto start_time = std::chrono::steady_clock::now();
+                SolveResult res = solver.solve( deals[ i ] );
+                auto elapsed = std::chrono::steady_clock::now() - start_time;
+
+                SeedResult r;
+                r.seed = seeds[ i ];
+                r.status = res.status;
+                r.moves = res.moves.size();
+                r.expanded = res.expanded;
+                r.micros = std::chrono::duration_cast< std::chrono::microseconds >( elapsed ).count();
+                if ( opts.moves )
+                {
+                    for ( const Move &m : res.moves )
+                    {
+                        r.solution.push_back( encode_move( m ) );
+                    }
+                }
+                batch.push_back( std::move( r ) );
+            }
+
+            if ( batch.size() >= 32 )
+            {
+                writer.write( batch );
+                batch.clear();
+            }
+        }
+
+        if ( batch.size() )
+        {
+            writer.write( batch );
+        }
+    };
+
+    std::vector< std::thread > threads;
+    for ( int i = 1; i < num_workers; ++i )
+    {
+        threads.emplace_back( worker, i );
+    }
+    worker( 0 );
+    for ( std::thread &t : threads )
+    {
+        t.join();
+    }
+
+    writer.checkpoint();
+    if ( out != stdout )
+    {
+        fclose( out );
+    }
+
+    return 0;
+}
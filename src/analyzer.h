@@ -0,0 +1,42 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+struct AnalyzeOptions
+{
+    uint64_t from = 0; // Inclusive
+    uint64_t to = 0;   // Inclusive
+    int threads = 1;
+    bool ms_deals = false; // Range is Microsoft deal numbers instead of seeds
+    bool moves = false;    // Append solutions to the lines of solved seeds
+
+    // Empty for stdout. When writing to a file, progress is checkpointed to
+    // <output>.checkpoint and an interrupted run resumes from there.
+    std::string output;
+};
+
+// Deals and solves every seed in range, writing one line per seed:
+//   <seed> <solved|unsolvable|unknown> <moves> <positions expanded> <microseconds>
+// With AnalyzeOptions::moves, solved lines end with a space and the moves of
+// the solution, each as 4 hex digits of encode_move().
+// Lines are written as seeds finish, so they are not in seed order.
+// Returns process exit code.
+int analyze_range( const AnalyzeOptions &opts );
@@ -0,0 +1,531 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+// Benchmarks for the engine, solver and renderer hot paths. Results are
+// printed as a single JSON object, so runs on different commits can be
+// compared by a script.
+//
+// The UI is built in, rather than linked, so that draw_frame() and
+// the undo history can be measured without splitting them out of the game.
+
+#define FREECELL_NO_MAIN
+#include "freecell.cpp"
+#include "move_scan.h"
+
+#include <fcntl.h>
+
+#include <cstdio>
+
+namespace bench {
+
+using Clock = std::chrono::steady_clock;
+
+// Keeps the compiler from dropping computations whose results are unused
+uint64_t sink = 0;
+
+double seconds_since( Clock::time_point start )
+{
+    return std::chrono::duration< double >( Clock::now() - start ).count();
+}
+
+// Fixed set of positions from random playouts, so that move generation is
+// measured on mid game positions too, not just fresh deals.
+std::vector< GameState > make_positions( int num_games, int max_depth )
+{
+    std::vector< GameState > positions;
+    std::mt19937 rng( 1 );
+
+    for ( int g = 0; g < num_games; ++g )
+    {
+        GameState st;
+        deal( st, 1000000 + g );
+        positions.push_back( st );
+
+        MoveList moves;
+        for ( int depth = 0; depth < max_depth; ++depth )
+        {
+            generate_moves( st, moves );
+            if ( moves.size == 0 )
+            {
+                break;
+            }
+            apply_move( st, moves.m_moves[ rng() % moves.size ] );
+            positions.push_back( st );
+        }
+    }
+
+    return positions;
+}
+
+class JsonWriter
+{
+public:
+    explicit JsonWriter( FILE *out ) : m_out( out )
+    {
+        std::fputs( "{", m_out );
+    }
+
+    void begin( const char *name )
+    {
+        std::fprintf( m_out, "%s\n  \"%s\": {", m_first_group ? "" : ",", name );
+        m_first_group = false;
+        m_first_field = true;
+    }
+
+    void field( const char *name, double val )
+    {
+        std::fprintf( m_out, "%s\n    \"%s\": %.6g", m_first_field ? "" : ",", name, val );
+        m_first_field = false;
+    }
+
+    void end()
+    {
+        std::fputs( "\n  }", m_out );
+    }
+
+    void finish()
+    {
+        std::fputs( "\n}\n", m_out );
+        std::fflush( m_out );
+    }
+
+private:
+    FILE *m_out;
+    bool m_first_group = true;
+    bool m_first_field = true;
+};
+
+void bench_moves( JsonWriter &json )
+{
+    const std::vector< GameState > positions = make_positions( 200, 100 );
+    const int rounds = 50;
+
+    MoveList moves;
+    uint64_t generated = 0;
+    auto start = Clock::now();
+    for ( int r = 0; r < rounds; ++r )
+    {
+        for ( const GameState &st : positions )
+        {
+            generate_moves( st, moves );
+            generated += moves.size;
+        }
+    }
+    double gen_secs = seconds_since( start );
+
+    uint64_t applied = 0;
+    start = Clock::now();
+    for ( int r = 0; r < rounds / 5; ++r )
+    {
+        for ( GameState st : positions )
+        {
+            generate_moves( st, moves );
+            for ( const Move &m : moves )
+            {
+                apply_move( st, m );
+                undo_move( st, m );
+            }
+            applied += moves.size;
+            sink += st.hash;
+        }
+    }
+    double apply_secs = seconds_since( start );
+
+    json.begin( "moves" );
+    json.field( "positions", positions.size() );
+    json.field( "generate_calls_per_sec", rounds * positions.size() / gen_secs );
+    json.field( "moves_generated_per_sec", generated / gen_secs );
+    json.field( "apply_undo_per_sec", applied / apply_secs );
+    json.end();
+}
+
+// The single card move scan of generate_moves, with each kernel the CPU runs
+void bench_move_scan( JsonWriter &json )
+{
+    const std::vector< GameState > positions = make_positions( 200, 100 );
+    const int rounds = 200;
+
+    json.begin( "move_scan" );
+    json.field( "best_kernel", static_cast< int >( best_scan_kernel() ) );
+
+    double scalar_rate = 0;
+    for ( ScanKernel kernel : { ScanKernel::Scalar, ScanKernel::Sse4, ScanKernel::Avx2 } )
+    {
+        if ( ! scan_kernel_supported( kernel ) )
+        {
+            continue;
+        }
+
+        MoveScan scan;
+        auto start = Clock::now();
+        for ( int r = 0; r < rounds; ++r )
+        {
+            for ( const GameState &st : positions )
+            {
+                scan_moves( st, scan, kernel );
+                sink += scan.to_foundation + scan.to_cascade[ r & 7 ];
+            }
+        }
+        const double rate = rounds * positions.size() / seconds_since( start );
+        scalar_rate = ( kernel == ScanKernel::Scalar ? rate : scalar_rate );
+
+        char name[ 64 ];
+        std::snprintf( name, sizeof( name ), "%s_scans_per_sec", scan_kernel_name( kernel ) );
+        json.field( name, rate );
+        if ( kernel != ScanKernel::Scalar )
+        {
+            std::snprintf( name, sizeof( name ), "%s_speedup", scan_kernel_name( kernel ) );
+            json.field( name, rate / scalar_rate );
+        }
+    }
+    json.end();
+}
+
+// Recording, undoing and redoing the moves of solved games, the way the game
+// keeps its undo history
+void bench_history( JsonWriter &json )
+{
+    std::vector< GameState > starts;
+    std::vector< std::vector< Move > > solutions;
+    Solver solver;
+    for ( int i = 0; i < 20; ++i )
+    {
+        GameState st;
+        deal( st, 1000000 + i );
+        starts.push_back( st );
+        solutions.push_back( solver.solve( st ).moves );
+    }
+
+    const int rounds = 2000;
+    uint64_t moves = 0;
+    double apply_secs = 0;
+    double undo_redo_secs = 0;
+
+    for ( int r = 0; r < rounds; ++r )
+    {
+        for ( size_t i = 0; i < starts.size(); ++i )
+        {
+            GameState st = starts[ i ];
+            player->history.reset( st );
+
+            auto start = Clock::now();
+            for ( const Move &m : solutions[ i ] )
+            {
+                player->history.apply( st, m );
+            }
+            apply_secs += seconds_since( start );
+
+            start = Clock::now();
+            while ( player->history.undo( st ) )
+            {
+            }
+            while ( player->history.redo( st ) )
+            {
+            }
+            undo_redo_secs += seconds_since( start );
+
+            moves += solutions[ i ].size();
+            sink += st.hash;
+        }
+    }
+
+    // Checking recorded games, as --replay does
+    std::vector< GameLog > logs( starts.size() );
+    for ( size_t i = 0; i < starts.size(); ++i )
+    {
+        logs[ i ].seed = 1000000 + i;
+        for ( const Move &m : solutions[ i ] )
+        {
+            logs[ i ].records.push_back( encode_move( m ) );
+        }
+    }
+
+    uint64_t records = 0;
+    auto start = Clock::now();
+    for ( int r = 0; r < rounds; ++r )
+    {
+        for ( const GameLog &log : logs )
+        {
+            GameState st;
+            start_game( log, st, player->history );
+            for ( uint16_t record : log.records )
+            {
+                records += apply_record( record, st, player->history );
+            }
+            sink += st.hash;
+        }
+    }
+    double replay_secs = seconds_since( start );
+
+    json.begin( "history" );
+    json.field( "apply_ns_per_move", apply_secs * 1e9 / moves );
+    json.field( "undo_redo_ns_per_move", undo_redo_secs * 1e9 / ( 2 * moves ) );
+    json.field( "replay_records_per_sec", records / replay_secs );
+    json.field( "bytes_per_move", sizeof( uint16_t ) + sizeof( PackedState ) / double( History::snapshot_interval ) );
+    json.end();
+}
+
+void bench_deal( JsonWriter &json )
+{
+    const int count = 200000;
+
+    std::vector< uint64_t > seeds( count );
+    for ( int i = 0; i < count; ++i )
+    {
+        seeds[ i ] = 1000000 + i;
+    }
+
+    GameState st;
+    auto start = Clock::now();
+    for ( uint64_t seed : seeds )
+    {
+        deal( st, seed );
+        sink += st.hash;
+    }
+    double deal_secs = seconds_since( start );
+
+    std::vector< GameState > batch( count );
+    start = Clock::now();
+    deal_batch( seeds.data(), seeds.size(), batch.data() );
+    double batch_secs = seconds_since( start );
+
+    start = Clock::now();
+    for ( int i = 1; i <= count; ++i )
+    {
+        deal_ms( st, i );
+        sink += st.hash;
+    }
+    double ms_secs = seconds_since( start );
+
+    // Cheap to check here, and a faster but wrong batch dealer would make
+    // every other number meaningless
+    int mismatches = 0;
+    for ( int i = 0; i < count; i += 97 )
+    {
+        deal( st, seeds[ i ] );
+        mismatches += ( pack( st ) != pack( batch[ i ] ) );
+    }
+
+    json.begin( "deal" );
+    json.field( "deals_per_sec", count / deal_secs );
+    json.field( "batch_deals_per_sec", count / batch_secs );
+    json.field( "ms_deals_per_sec", count / ms_secs );
+    json.field( "batch_mismatches", mismatches );
+    json.end();
+}
+
+void bench_solver( JsonWriter &json )
+{
+    const int num_seeds = 100;
+
+    Solver solver;
+    std::vector< double > times;
+    uint64_t expanded = 0;
+    int solved = 0;
+
+    auto start = Clock::now();
+    for ( int i = 0; i < num_seeds; ++i )
+    {
+        GameState st;
+        deal( st, 1000000 + i );
+
+        auto solve_start = Clock::now();
+        SolveResult res = solver.solve( st );
+        times.push_back( seconds_since( solve_start ) );
+
+        expanded += res.expanded;
+        solved += ( res.status == SolveStatus::Solved );
+    }
+    double secs = seconds_since( start );
+
+    std::sort( times.begin(), times.end() );
+
+    json.begin( "solver" );
+    json.field( "deals", num_seeds );
+    json.field( "solved", solved );
+    json.field( "nodes_per_sec", expanded / secs );
+    json.field( "total_ms", secs * 1e3 );
+    json.field( "median_ms", times[ times.size() / 2 ] * 1e3 );
+    json.field( "p90_ms", times[ times.size() * 9 / 10 ] * 1e3 );
+    json.field( "max_ms", times.back() * 1e3 );
+    json.end();
+}
+
+// Deals that take the single threaded solver close to a second, solved again
+// with a thread per core
+void bench_parallel_solver( JsonWriter &json )
+{
+    const uint64_t seeds[] = { 1000432, 1000578, 1000984, 1001163 };
+    const int threads = std::max( 2u, std::thread::hardware_concurrency() );
+
+    SolverOptions parallel_opts;
+    parallel_opts.threads = threads;
+
+    double serial_secs = 0;
+    double parallel_secs = 0;
+    uint64_t serial_expanded = 0;
+    uint64_t parallel_expanded = 0;
+    int solved = 0;
+
+    for ( uint64_t seed : seeds )
+    {
+        GameState st;
+        deal( st, seed );
+
+        auto start = Clock::now();
+        SolveResult res = solve( st );
+        serial_secs += seconds_since( start );
+        serial_expanded += res.expanded;
+
+        start = Clock::now();
+        res = solve( st, parallel_opts );
+        parallel_secs += seconds_since( start );
+        parallel_expanded += res.expanded;
+        solved += ( res.status == SolveStatus::Solved );
+    }
+
+    json.begin( "parallel_solver" );
+    json.field( "deals", std::size( seeds ) );
+    json.field( "threads", threads );
+    json.field( "solved", solved );
+    json.field( "serial_ms", serial_secs * 1e3 );
+    json.field( "parallel_ms", parallel_secs * 1e3 );
+    json.field( "speedup", serial_secs / parallel_secs );
+    json.field( "serial_nodes_per_sec", serial_expanded / serial_secs );
+    json.field( "parallel_nodes_per_sec", parallel_expanded / parallel_secs );
+    json.end();
+}
+
+// Typical terminal input: key repeats, mouse drags and a paste, decoded in
+// reads of the size the game uses
+void bench_input( JsonWriter &json )
+{
+    std::string data;
+    for ( int i = 0; i < 20000; ++i )
+    {
+        data += "\033[C\033[D \r";
+        data += "\033[<32;" + std::to_string( 10 + i % 50 ) + ";" + std::to_string( 5 + i % 20 ) + "M";
+        data += "u\033[1;5A\033OP";
+    }
+    data += "\033[200~";
+    for ( int i = 0; i < 20000; ++i )
+    {
+        data += "pasted text, \303\251\r";
+    }
+    data += "\033[201~";
+
+    const int rounds = 20;
+    const size_t read_size = 4096;
+    std::vector< InputEvent > events;
+    uint64_t num_events = 0;
+
+    auto start = Clock::now();
+    for ( int r = 0; r < rounds; ++r )
+    {
+        InputDecoder decoder;
+        for ( size_t pos = 0; pos < data.size(); pos += read_size )
+        {
+            events.clear();
+            decoder.feed( data.data() + pos, std::min( read_size, data.size() - pos ), events );
+            num_events += events.size();
+        }
+    }
+    double secs = seconds_since( start );
+
+    json.begin( "input" );
+    json.field( "mb_per_sec", rounds * data.size() / secs / 1e6 );
+    json.field( "events_per_sec", num_events / secs );
+    json.end();
+}
+
+// Plays back a solved game with the cursor moving between moves, the way a
+// player would, and renders every step.
+void bench_render( JsonWriter &json )
+{
+    player->term_size.ws_row = 50;
+    player->term_size.ws_col = 120;
+
+    player->game_seed = 1000000;
+    deal_game( player->game );
+    SolveResult res = solve( player->game );
+
+    // Full redraw, as after a resize
+    player->screen.invalidate();
+    auto start = Clock::now();
+    draw_frame();
+    double full_secs = seconds_since( start );
+    size_t full_bytes = player->term_out.stats().last_frame_bytes;
+
+    const OutputStats before = player->term_out.stats();
+    int frames = 0;
+    start = Clock::now();
+    for ( int r = 0; r < 20; ++r )
+    {
+        deal_game( player->game );
+        player->history.reset( player->game );
+        for ( const Move &m : res.moves )
+        {
+            process_key( r % 2 ? Key::ArrowLeft : Key::ArrowRight );
+            draw_frame();
+
+            player->history.apply( player->game, m );
+            draw_frame();
+            frames += 2;
+        }
+    }
+    double secs = seconds_since( start );
+    const OutputStats &after = player->term_out.stats();
+
+    json.begin( "render" );
+    json.field( "full_frame_bytes", full_bytes );
+    json.field( "full_frame_ns", full_secs * 1e9 );
+    json.field( "frames", frames );
+    json.field( "bytes_per_frame", static_cast< double >( after.bytes - before.bytes ) / frames );
+    json.field( "ns_per_frame", secs * 1e9 / frames );
+    json.end();
+}
+
+} // namespace bench
+
+int main()
+{
+    // Frames go to stdout, so results are written to a copy of it and the
+    // original is pointed at /dev/null
+    int result_fd = dup( STDOUT_FILENO );
+    int null_fd = open( "/dev/null", O_WRONLY );
+    if ( result_fd < 0 || null_fd < 0 || dup2( null_fd, STDOUT_FILENO ) < 0 )
+    {
+        std::perror( "freecell_bench" );
+        return 1;
+    }
+    close( null_fd );
+
+    FILE *out = fdopen( result_fd, "w" );
+    bench::JsonWriter json( out );
+
+    bench::bench_moves( json );
+    bench::bench_move_scan( json );
+    bench::bench_history( json );
+    bench::bench_deal( json );
+    bench::bench_solver( json );
+    bench::bench_parallel_solver( json );
+    bench::bench_input( json );
+    bench::bench_render( json );
+
+    json.finish();
+    return 0;
+}
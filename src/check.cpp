@@ -0,0 +1,186 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+// Checks, run by "make check", for code that depends on something outside
+// of this repository staying the same. Exits with status 1 if any fails.
+
+#include "deal.h"
+#include "engine.h"
+#include "packed_state.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+// deal_batch() mirrors the way libstdc++ implements std::shuffle, which
+// deal() uses, so it has to be checked against it with every toolchain
+void check_deal_batch()
+{
+    std::vector< uint64_t > seeds = { 0, 1, 2, UINT64_MAX, UINT64_MAX - 1, 1ull << 63, 1ull << 32 };
+    for ( uint64_t seed = 1000000; seed < 1010000; ++seed )
+    {
+        seeds.push_back( seed );
+    }
+    std::mt19937_64 rng( 12345 );
+    for ( int i = 0; i < 10000; ++i )
+    {
+        seeds.push_back( rng() );
+    }
+
+    std::vector< GameState > states( seeds.size() );
+    std::vector< PackedState > packed( seeds.size() );
+    deal_batch( seeds.data(), seeds.size(), states.data() );
+    deal_batch( seeds.data(), seeds.size(), packed.data() );
+
+    int mismatches = 0;
+    GameState st;
+    for ( size_t i = 0; i < seeds.size(); ++i )
+    {
+        deal( st, seeds[ i ] );
+        const PackedState expected = pack( st );
+        if ( pack( states[ i ] ) != expected || packed[ i ] != expected )
+        {
+            if ( mismatches++ < 10 )
+            {
+                fprintf( stderr, "deal_batch: seed %" PRIu64 " differs from deal()\n", seeds[ i ] );
+            }
+        }
+    }
+
+    printf( "deal_batch: %zu seeds, %d mismatches\n", seeds.size(), mismatches );
+    failures += ( mismatches > 0 );
+}
+
+// Cascades row by row, eight cards to a line, as deals are usually listed
+std::string layout( const GameState &st )
+{
+    std::string res;
+    for ( int i = 0; i < 52; ++i )
+    {
+        const Card c = card_from_code( st.cascades[ i % 8 ].m_cards[ i / 8 ] );
+        res += "?A23456789TJQK"[ static_cast< int >( c.m_number ) ];
+        res += "?HDCS"[ static_cast< int >( c.m_suit ) ];
+        res += ( i % 8 == 7 || i == 51 ? '\n' : ' ' );
+    }
+    return res;
+}
+
+// fc-solve's generator for deal numbers (microsoft_rand__game_num_rand) and
+// the Microsoft dealing order, written out separately from deal_ms()
+std::string reference_ms_layout( uint64_t deal_number )
+{
+    uint64_t seedx = ( deal_number < 0x100000000 ? deal_number : deal_number - 0x100000000 );
+    auto rand = [ & ]() -> uint64_t
+    {
+        seedx = seedx * 214013 + 2531011;
+        if ( deal_number < 0x100000000 )
+        {
+            const uint64_t ret = ( seedx >> 16 ) & 0x7fff;
+            return deal_number < 0x80000000 ? ret : ( ret | 0x8000 );
+        }
+        return ( ( seedx >> 16 ) & 0xffff ) + 1;
+    };
+
+    std::vector< std::string > deck;
+    for ( const char *rank = "A23456789TJQK"; *rank; ++rank )
+    {
+        for ( const char *suit = "CDHS"; *suit; ++suit )
+        {
+            deck.push_back( std::string( 1, *rank ) + *suit );
+        }
+    }
+
+    std::string res;
+    for ( int i = 0; i < 52; ++i )
+    {
+        const size_t j = rand() % deck.size();
+        res += deck[ j ] + ( i % 8 == 7 || i == 51 ? "\n" : " " );
+        deck[ j ] = deck.back();
+        deck.pop_back();
+    }
+    return res;
+}
+
+void check_deal_ms()
+{
+    // As published, for example on Rosetta Code ("Deal cards for FreeCell")
+    const struct
+    {
+        uint64_t deal_number;
+        const char *layout;
+    } published[] = {
+        { 1, "JD 2D 9H JC 5D 7H 7C 5H\n"
+             "KD KC 9S 5S AD QC KH 3H\n"
+             "2S KS 9D QD JS AS AH 3C\n"
+             "4C 5C TS QH 4H AC 4D 7S\n"
+             "3S TD 4S TH 8H 2C JH 7D\n"
+             "6D 8S 8D QS 6C 3D 8C TC\n"
+             "6S 9C 2H 6H\n" },
+        { 617, "7D AD 5C 3S 5S 8C 2D AH\n"
+               "TD 7S QD AC 6D 8H AS KH\n"
+               "TH QC 3H 9D 6S 8D 3D TC\n"
+               "KD 5H 9S 3C 8S 7H 4D JS\n"
+               "4C QS 9C 9H 7C 6H 2C 2S\n"
+               "4S TS 2H 5D JC 6C JH QH\n"
+               "JD KS KC 4H\n" },
+    };
+
+    int mismatches = 0;
+    GameState st;
+    for ( const auto &p : published )
+    {
+        deal_ms( st, p.deal_number );
+        if ( layout( st ) != p.layout )
+        {
+            fprintf( stderr, "deal_ms: deal %" PRIu64 " differs from its published layout\n", p.deal_number );
+            ++mismatches;
+        }
+    }
+
+    // Each range of the extension, and its ends
+    const uint64_t deal_numbers[] = {
+        1, 32000, 0x7fffffff, 0x80000000, 3000000000, 0xffffffff,
+        0x100000000, 0x100000001, 6000000000, max_ms_deal,
+    };
+    for ( uint64_t deal_number : deal_numbers )
+    {
+        deal_ms( st, deal_number );
+        if ( layout( st ) != reference_ms_layout( deal_number ) )
+        {
+            fprintf( stderr, "deal_ms: deal %" PRIu64 " differs from the reference generator\n", deal_number );
+            ++mismatches;
+        }
+    }
+
+    printf( "deal_ms: %zu deals, %d mismatches\n", std::size( published ) + std::size( deal_numbers ), mismatches );
+    failures += ( mismatches > 0 );
+}
+
+} // namespace
+
+int main()
+{
+    check_deal_batch();
+    check_deal_ms();
+    return failures ? 1 : 0;
+}
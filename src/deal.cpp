@@ -0,0 +1,244 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "deal.h"
+
+
+#include <algorithm>
+#include <array>
+
+// std::shuffle of 52 cards consumes only about 26 numbers from the generator,
+// since libstdc++ derives two swap positions from a single 64 bit draw. The
+// n-th output of mt19937_64 (for n < 156) depends on words n, n+1 and n+156 of
+// the seeded state, so only the first 188 of its 312 state words are needed
+// for the first 32 draws, and only the words that are drawn are twisted.
+//
+// Seeding is a serial chain of multiplications, so deals are set up in groups
+// that advance in lockstep, letting independent chains overlap.
+//
+// The shuffle below mirrors std::shuffle and uniform_int_distribution of
+// libstdc++ from GCC 11 on. With other standard libraries deal() is used.
+#if defined( __GLIBCXX__ ) && defined( __SIZEOF_INT128__ ) && _GLIBCXX_RELEASE >= 11
+#define FAST_DEAL 1
+#else
+#define FAST_DEAL 0
+#endif
+
+namespace {
+
+__extension__ typedef unsigned __int128 uint128_t;
+
+const int lanes = 8;
+const int max_draws = 32;
+const int seed_words = max_draws + 156;
+
+// Generator for one lane, reading seeded words that are laid out lane-major
+class LaneMt19937
+{
+public:
+    LaneMt19937( const uint64_t *words, int lane ) : m_words( words ), m_lane( lane ) {}
+
+    bool exhausted() const { return m_pos >= max_draws; }
+
+    uint64_t operator()()
+    {
+        if ( exhausted() )
+        {
+            // Caller redoes the deal the slow way
+            return 0;
+        }
+
+        const uint64_t upper_mask = ~uint64_t( 0 ) << 31;
+
+        int k = m_pos++;
+        uint64_t y = ( word( k ) & upper_mask ) | ( word( k + 1 ) & ~upper_mask );
+        uint64_t z = word( k + 156 ) ^ ( y >> 1 ) ^ ( ( y & 1 ) ? 0xB5026F5AA96619E9ull : 0 );
+
+        z ^= ( z >> 29 ) & 0x5555555555555555ull;
+        z ^= ( z << 17 ) & 0x71D67FFFEDA60000ull;
+        z ^= ( z << 37 ) & 0xFFF7EEE000000000ull;
+        z ^= ( z >> 43 );
+        return z;
+    }
+
+private:
+    uint64_t word( int i ) const { return m_words[ i * lanes + m_lane ]; }
+
+    const uint64_t *m_words;
+    int m_lane;
+    int m_pos = 0;
+};
+
+// uniform_int_distribution{ 0, range - 1 } for a 64 bit generator
+uint64_t uniform( LaneMt19937 &g, uint64_t range )
+{
+    uint128_t product = static_cast< uint128_t >( g() ) * range;
+    uint64_t low = product;
+    if ( low < range )
+    {
+        uint64_t threshold = -range % range;
+        while ( low < threshold && ! g.exhausted() )
+        {
+            product = static_cast< uint128_t >( g() ) * range;
+            low = product;
+        }
+    }
+    return product >> 64;
+}
+
+// Returns false if the generator ran out of precomputed words
+bool shuffle( std::array< uint8_t, 52 > &deck, LaneMt19937 &g )
+{
+    // 52 is even, so one swap is done alone before the pairs
+    std::swap( deck[ 1 ], deck[ uniform( g, 2 ) ] );
+
+    for ( uint64_t i = 2; i < 52; i += 2 )
+    {
+        uint64_t x = uniform( g, ( i + 1 ) * ( i + 2 ) );
+        std::swap( deck[ i ], deck[ x / ( i + 2 ) ] );
+        std::swap( deck[ i + 1 ], deck[ x % ( i + 2 ) ] );
+    }
+
+    return ! g.exhausted();
+}
+
+// Calls out( i, st ) with the deal of each seed
+template < typename Output >
+void deal_batch_impl( const uint64_t *seeds, size_t count, Output out )
+{
+    GameState st;
+
+#if FAST_DEAL
+    uint64_t words[ seed_words * lanes ];
+
+    for ( size_t base = 0; base < count; base += lanes )
+    {
+        const int n = std::min< size_t >( lanes, count - base );
+
+        for ( int lane = 0; lane < lanes; ++lane )
+        {
+            words[ lane ] = seeds[ base + std::min( lane, n - 1 ) ];
+        }
+
+        for ( int i = 1; i < seed_words; ++i )
+        {
+            for ( int lane = 0; lane < lanes; ++lane )
+            {
+                uint64_t prev = words[ ( i - 1 ) * lanes + lane ];
+                words[ i * lanes + lane ] = 6364136223846793005ull * ( prev ^ ( prev >> 62 ) ) + i;
+            }
+        }
+
+        for ( int lane = 0; lane < n; ++lane )
+        {
+            // Same order as deal() starts from
+            std::array< CardCode, 52 > deck;
+            for ( int i = 0; i < 52; ++i )
+            {
+                deck[ i ] = make_card( i / 13, i % 13 + 1 );
+            }
+
+            LaneMt19937 g( words, lane );
+            if ( shuffle( deck, g ) )
+            {
+                st = GameState();
+                for ( int i = 0; i < 52; ++i )
+                {
+                    Cascade &cascade = st.cascades[ i % 8 ];
+                    cascade.m_cards[ cascade.size++ ] = deck[ i ];
+                }
+                update_derived( st );
+            }
+            else
+            {
+                deal( st, seeds[ base + lane ] );
+            }
+
+            out( base + lane, st );
+        }
+    }
+#else
+    for ( size_t i = 0; i < count; ++i )
+    {
+        deal( st, seeds[ i ] );
+        out( i, st );
+    }
+#endif
+}
+
+} // namespace
+
+void deal_batch( const uint64_t *seeds, size_t count, GameState *out )
+{
+    deal_batch_impl( seeds, count, [ out ]( size_t i, const GameState &st ) { out[ i ] = st; } );
+}
+
+void deal_batch( const uint64_t *seeds, size_t count, PackedState *out )
+{
+    deal_batch_impl( seeds, count, [ out ]( size_t i, const GameState &st ) { out[ i ] = pack( st ); } );
+}
+
+void deal_ms( GameState &st, uint64_t deal_number )
+{
+    // Linear congruential generator of the Microsoft C runtime, with the
+    // extensions for deals from 2^31 on as PySol and fc-solve have them:
+    // from 2^32 on, 16 bits of the state are taken instead of 15, plus one
+    uint64_t seed = ( deal_number < ( uint64_t( 1 ) << 32 ) ? deal_number : deal_number - ( uint64_t( 1 ) << 32 ) );
+    auto rand = [ & ]() -> uint32_t
+    {
+        seed = ( seed * 214013 + 2531011 ) & 0xFFFFFFFF;
+
+        if ( deal_number >= ( uint64_t( 1 ) << 32 ) )
+        {
+            return ( ( seed >> 16 ) & 0xFFFF ) + 1;
+        }
+        const uint32_t r = ( seed >> 16 ) & 0x7FFF;
+        if ( deal_number >= ( uint64_t( 1 ) << 31 ) )
+        {
+            return r | 0x8000;
+        }
+        return r;
+    };
+
+    // Card i of the deck is rank i / 4, in the suit order clubs, diamonds,
+    // hearts, spades
+    static const Suit ms_suits[] = { Suit::Clubs, Suit::Diamonds, Suit::Hearts, Suit::Spades };
+
+    std::array< uint8_t, 52 > deck;
+    for ( int i = 0; i < 52; ++i )
+    {
+        deck[ i ] = i;
+    }
+
+    st = GameState();
+    int left = 52;
+    for ( int i = 0; i < 52; ++i )
+    {
+        int j = rand() % left;
+
+        Card c;
+        c.m_suit = ms_suits[ deck[ j ] % 4 ];
+        c.m_number = static_cast< Number >( deck[ j ] / 4 + 1 );
+
+        Cascade &cascade = st.cascades[ i % 8 ];
+        cascade.m_cards[ cascade.size++ ] = card_code( c );
+
+        deck[ j ] = deck[ --left ];
+    }
+
+    update_derived( st );
+}
@@ -0,0 +1,41 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+// Dealing games other than one at a time with deal().
+//
+// Dealing many games at once. Layouts are identical to deal(), which uses
+// std::shuffle with std::mt19937_64, but without setting up a full generator
+// for every seed.
+
+#include "engine.h"
+#include "packed_state.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Deals game for seeds[ i ] into out[ i ], for i < count
+void deal_batch( const uint64_t *seeds, size_t count, GameState *out );
+void deal_batch( const uint64_t *seeds, size_t count, PackedState *out );
+
+// Microsoft FreeCell deals. Numbers 1 to 32000 are the original set, the rest
+// of the range is the extension used by later versions and other solvers
+// (PySol, fc-solve).
+const uint64_t max_ms_deal = 8589934591; // 2^33 - 1
+
+void deal_ms( GameState &st, uint64_t deal_number );
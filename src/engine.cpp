@@ -0,0 +1,483 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "engine.h"
+
+#include "move_scan.h"
+#include "zobrist.h"
+
+#include <algorithm>
+#include <random>
+
+void deal( GameState &st, uint64_t seed )
+{
+    st = GameState();
+
+    std::array< CardCode, 52 > deck;
+    for ( int i = 0; i < 52; ++i )
+    {
+        deck[ i ] = make_card( i / 13, i % 13 + 1 );
+    }
+
+    std::shuffle( deck.begin(), deck.end(), std::mt19937_64( seed ) );
+
+    Cascade *cur_cascade = &st.cascades[ 0 ];
+    for ( CardCode c : deck )
+    {
+        cur_cascade->m_cards[ cur_cascade->size++ ] = c;
+        ++cur_cascade;
+        if ( cur_cascade == st.cascades.end() )
+        {
+           cur_cascade = &st.cascades[ 0 ];
+        }
+    }
+
+    update_derived( st );
+}
+
+void update_derived( GameState &st )
+{
+    st.empty_cells = 0;
+    st.exposed = 0;
+    for ( CardCode c : st.cells )
+    {
+        st.empty_cells += ! c;
+        st.exposed |= card_bit( c );
+    }
+
+    st.empty_cascades = 0;
+    for ( const Cascade &cascade : st.cascades )
+    {
+        st.empty_cascades += ( cascade.size == 0 );
+        st.exposed |= ( cascade.size ? card_bit( cascade.m_cards[ cascade.size - 1 ] ) : 0 );
+    }
+
+    st.hash = zobrist_hash( st );
+}
+
+bool is_full_foundations( const GameState &st )
+{
+    return card_rank( st.foundations[ 0 ] ) == 13 && card_rank( st.foundations[ 1 ] ) == 13
+        && card_rank( st.foundations[ 2 ] ) == 13 && card_rank( st.foundations[ 3 ] ) == 13;
+}
+
+namespace {
+
+CardCode top_card( const Cascade &cascade )
+{
+    return cascade.m_cards[ cascade.size - 1 ];
+}
+
+// Top card, 0 for an empty cascade
+CardCode top_or_none( const Cascade &cascade )
+{
+    return cascade.size ? cascade.m_cards[ cascade.size - 1 ] : 0;
+}
+
+// Number of cards to move from one cascade to a non empty one, 0 if not possible
+int cards_to_stack( const Cascade &from, const Cascade &to, int run, int max_cards )
+{
+    // Only one card of the run can go under the destination card
+    const CardCode target = top_card( to );
+    int num_cards = card_rank( target ) - card_rank( top_card( from ) );
+    if ( num_cards < 1 || num_cards > run || num_cards > max_cards )
+    {
+        return 0;
+    }
+
+    return can_stack( from.m_cards[ from.size - num_cards ], target ) ? num_cards : 0;
+}
+
+CardCode take_card( GameState &st, Location loc, int idx )
+{
+    CardCode c = 0;
+    switch ( loc )
+    {
+    case Location::Cascade:
+    {
+        Cascade &cascade = st.cascades[ idx ];
+        c = top_card( cascade );
+        cascade.size--;
+        st.empty_cascades += ( cascade.size == 0 );
+        st.exposed ^= card_bit( c ) | card_bit( top_or_none( cascade ) );
+        break;
+    }
+    case Location::Cell:
+        c = st.cells[ idx ];
+        st.cells[ idx ] = 0;
+        ++st.empty_cells;
+        st.exposed ^= card_bit( c );
+        break;
+    case Location::Foundation:
+        // Ranks below the ace are 0, which leaves the foundation empty
+        c = st.foundations[ idx ];
+        st.foundations[ idx ] = ( card_rank( c ) > 1 ? c - 1 : 0 );
+        break;
+    }
+    return c;
+}
+
+void put_card( GameState &st, Location loc, int idx, CardCode c )
+{
+    switch ( loc )
+    {
+    case Location::Cascade:
+    {
+        Cascade &cascade = st.cascades[ idx ];
+        st.empty_cascades -= ( cascade.size == 0 );
+        st.exposed ^= card_bit( top_or_none( cascade ) ) | card_bit( c );
+        cascade.m_cards[ cascade.size++ ] = c;
+        break;
+    }
+    case Location::Cell:
+        st.cells[ idx ] = c;
+        --st.empty_cells;
+        st.exposed ^= card_bit( c );
+        break;
+    case Location::Foundation:
+        st.foundations[ idx ] = c;
+        break;
+    }
+}
+
+void move_cards( GameState &st, Location from, int from_idx, Location to, int to_idx, int count )
+{
+    if ( from == Location::Cascade && to == Location::Cascade )
+    {
+        Cascade &src = st.cascades[ from_idx ];
+        Cascade &dst = st.cascades[ to_idx ];
+
+        std::copy( src.m_cards.begin() + src.size - count,
+                   src.m_cards.begin() + src.size,
+                   dst.m_cards.begin() + dst.size );
+
+        // The bottom card of the source stays exposed, at the bottom of the
+        // destination
+        st.exposed ^= card_bit( top_or_none( dst ) );
+        st.empty_cascades += ( src.size == count ) - ( dst.size == 0 );
+        src.size -= count;
+        dst.size += count;
+        st.exposed ^= card_bit( top_or_none( src ) );
+        return;
+    }
+
+    put_card( st, to, to_idx, take_card( st, from, from_idx ) );
+}
+
+} // namespace
+
+int movable_run( const Cascade &cascade )
+{
+    int num_cards = cascade.size > 0;
+    while ( num_cards < cascade.size
+         && can_stack( cascade.m_cards[ cascade.size - num_cards ], cascade.m_cards[ cascade.size - num_cards - 1 ] ) )
+    {
+        ++num_cards;
+    }
+    return num_cards;
+}
+
+bool resolve_move( const GameState &st, Move &m )
+{
+    CardCode card = 0;
+    switch ( m.from )
+    {
+    case Location::Cascade:
+        if ( st.cascades[ m.from_idx ].size == 0 )
+        {
+            return false;
+        }
+        card = top_card( st.cascades[ m.from_idx ] );
+        break;
+    case Location::Cell:
+        if ( ! st.cells[ m.from_idx ] )
+        {
+            return false;
+        }
+        card = st.cells[ m.from_idx ];
+        break;
+    case Location::Foundation:
+        return false;
+    }
+
+    const int wanted = m.count ? m.count : 52;
+    m.count = 1;
+
+    switch ( m.to )
+    {
+    case Location::Foundation:
+        m.to_idx = card_suit( card );
+        return can_move_to_foundation( st, card );
+    case Location::Cell:
+        return m.from == Location::Cascade && ! st.cells[ m.to_idx ];
+    case Location::Cascade:
+        break;
+    }
+
+    const Cascade &to = st.cascades[ m.to_idx ];
+
+    if ( m.from == Location::Cell )
+    {
+        return to.size == 0 || can_stack( card, top_card( to ) );
+    }
+
+    if ( m.from_idx == m.to_idx )
+    {
+        return false;
+    }
+
+    const Cascade &from = st.cascades[ m.from_idx ];
+    int run = movable_run( from );
+
+    if ( to.size == 0 )
+    {
+        m.count = std::min( { wanted, run, max_movable_cards( st, true ) } );
+        return true;
+    }
+
+    m.count = cards_to_stack( from, to, std::min( wanted, run ), max_movable_cards( st, false ) );
+    return m.count > 0;
+}
+
+void generate_moves( const GameState &st, MoveList &moves )
+{
+    moves.size = 0;
+
+    auto add = [ & ]( Location from, int from_idx, Location to, int to_idx, int count )
+    {
+        Move &m = moves.m_moves[ moves.size++ ];
+        m.from = from;
+        m.from_idx = from_idx;
+        m.to = to;
+        m.to_idx = to_idx;
+        m.count = count;
+    };
+
+    int first_empty_cascade = -1;
+    for ( int i = 0; i < 8 && st.empty_cascades; ++i )
+    {
+        if ( st.cascades[ i ].size == 0 )
+        {
+            first_empty_cascade = i;
+            break;
+        }
+    }
+
+    int first_empty_cell = -1;
+    uint64_t in_cells = 0;
+    for ( int i = 0; i < 4; ++i )
+    {
+        if ( ! st.cells[ i ] && first_empty_cell < 0 )
+        {
+            first_empty_cell = i;
+        }
+        in_cells |= card_bit( st.cells[ i ] );
+    }
+
+    const int max_cards = max_movable_cards( st, false );
+    const int max_cards_to_empty = max_cards / 2;
+
+    // Single card moves, for all sources at once
+    MoveScan scan;
+    scan_moves( st, scan );
+
+    // Cards that something can go on
+    const uint64_t tops = st.exposed & ~in_cells;
+
+    for ( int cell_idx = 0; cell_idx < 4; ++cell_idx )
+    {
+        const CardCode c = st.cells[ cell_idx ];
+        if ( ! c )
+        {
+            continue;
+        }
+
+        const int src = 8 + cell_idx;
+        if ( scan.to_foundation >> src & 1 )
+        {
+            add( Location::Cell, cell_idx, Location::Foundation, card_suit( c ), 1 );
+        }
+
+        for ( int to_idx = 0; to_idx < 8; ++to_idx )
+        {
+            if ( scan.to_cascade[ to_idx ] >> src & 1 || to_idx == first_empty_cascade )
+            {
+                add( Location::Cell, cell_idx, Location::Cascade, to_idx, 1 );
+            }
+        }
+    }
+
+    for ( int from_idx = 0; from_idx < 8; ++from_idx )
+    {
+        const Cascade &from = st.cascades[ from_idx ];
+        if ( from.size == 0 )
+        {
+            continue;
+        }
+
+        const CardCode c = top_card( from );
+        if ( scan.to_foundation >> from_idx & 1 )
+        {
+            add( Location::Cascade, from_idx, Location::Foundation, card_suit( c ), 1 );
+        }
+
+        // What the cards of the run above the top one can go on. Ranks in a
+        // run are consecutive, so the number of cards to move follows from
+        // the rank of the target.
+        const int run = movable_run( from );
+        const int longest = std::min( run, max_cards );
+        uint64_t targets = 0;
+        for ( int i = 2; i <= longest; ++i )
+        {
+            targets |= stacking_targets[ from.m_cards[ from.size - i ] ];
+        }
+        targets &= tops;
+
+        for ( int to_idx = 0; to_idx < 8; ++to_idx )
+        {
+            const Cascade &to = st.cascades[ to_idx ];
+            if ( to_idx == from_idx )
+            {
+                continue;
+            }
+
+            if ( to.size == 0 )
+            {
+                if ( to_idx == first_empty_cascade )
+                {
+                    // Moving the whole cascade to an empty one changes nothing
+                    const int longest_to_empty = std::min( run, max_cards_to_empty );
+                    for ( int count = 1; count <= longest_to_empty && count < from.size; ++count )
+                    {
+                        add( Location::Cascade, from_idx, Location::Cascade, to_idx, count );
+                    }
+                }
+                continue;
+            }
+
+            if ( scan.to_cascade[ to_idx ] >> from_idx & 1 )
+            {
+                add( Location::Cascade, from_idx, Location::Cascade, to_idx, 1 );
+            }
+            else if ( targets & card_bit( top_card( to ) ) )
+            {
+                add( Location::Cascade, from_idx, Location::Cascade, to_idx, card_rank( top_card( to ) ) - card_rank( c ) );
+            }
+        }
+
+        if ( first_empty_cell >= 0 )
+        {
+            add( Location::Cascade, from_idx, Location::Cell, first_empty_cell, 1 );
+        }
+    }
+}
+
+namespace {
+
+// Cards of each color up to each rank
+constexpr std::array< std::array< uint64_t, 15 >, 2 > make_cards_up_to()
+{
+    std::array< std::array< uint64_t, 15 >, 2 > masks = {};
+    for ( int black = 0; black < 2; ++black )
+    {
+        for ( int max_rank = 1; max_rank < 15; ++max_rank )
+        {
+            for ( int rank = 1; rank <= std::min( max_rank, 13 ); ++rank )
+            {
+                masks[ black ][ max_rank ] |= card_bit( make_card( 2 * black, rank ) ) | card_bit( make_card( 2 * black + 1, rank ) );
+            }
+        }
+    }
+    return masks;
+}
+
+constexpr std::array< std::array< uint64_t, 15 >, 2 > cards_up_to = make_cards_up_to();
+
+} // namespace
+
+bool find_safe_move( const GameState &st, Move &m )
+{
+    const uint64_t candidates = st.exposed & foundation_cards( st );
+    if ( ! candidates )
+    {
+        return false;
+    }
+
+    // Lowest rank on foundations of each color. Cards up to one above that
+    // of the other color are safe, and aces and twos always are.
+    int min_red = std::min( card_rank( st.foundations[ 0 ] ), card_rank( st.foundations[ 1 ] ) );
+    int min_black = std::min( card_rank( st.foundations[ 2 ] ), card_rank( st.foundations[ 3 ] ) );
+    const uint64_t safe = candidates & ( cards_up_to[ 0 ][ std::max( 2, min_black + 1 ) ]
+                                       | cards_up_to[ 1 ][ std::max( 2, min_red + 1 ) ] );
+    if ( ! safe )
+    {
+        return false;
+    }
+
+    for ( int i = 0; i < 4; ++i )
+    {
+        if ( safe & card_bit( st.cells[ i ] ) )
+        {
+            m.from = Location::Cell;
+            m.from_idx = i;
+            m.to = Location::Foundation;
+            m.to_idx = card_suit( st.cells[ i ] );
+            m.count = 1;
+            return true;
+        }
+    }
+
+    for ( int i = 0; i < 8; ++i )
+    {
+        if ( st.cascades[ i ].size && ( safe & card_bit( top_card( st.cascades[ i ] ) ) ) )
+        {
+            m.from = Location::Cascade;
+            m.from_idx = i;
+            m.to = Location::Foundation;
+            m.to_idx = card_suit( top_card( st.cascades[ i ] ) );
+            m.count = 1;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int auto_play( GameState &st, MoveList &moves )
+{
+    int count = 0;
+    Move m;
+    while ( find_safe_move( st, m ) )
+    {
+        apply_move( st, m );
+        moves.m_moves[ moves.size++ ] = m;
+        ++count;
+    }
+    return count;
+}
+
+void apply_move( GameState &st, const Move &m )
+{
+    st.hash ^= move_hash_delta( st, m );
+    move_cards( st, m.from, m.from_idx, m.to, m.to_idx, m.count );
+}
+
+void undo_move( GameState &st, const Move &m )
+{
+    move_cards( st, m.to, m.to_idx, m.from, m.from_idx, m.count );
+    st.hash ^= move_hash_delta( st, m );
+}
@@ -0,0 +1,238 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+// Game rules, without any terminal or global state. Everything here operates
+// on explicit GameState objects, so it can be driven by the interactive game
+// as well as batch tools.
+
+#include <array>
+#include <cstdint>
+
+enum class Suit : uint8_t
+{
+    None,
+    Hearts,
+    Diamonds,
+    Clubs,
+    Spades,
+};
+
+enum class Number : uint8_t
+{
+    None,
+    Ace, Two, Three, Four, Five, Six, Seven, Eight, Nine, Ten, Jack, Queen, King,
+};
+
+// Card as the interface shows it. The engine keeps cards as CardCode.
+struct Card
+{
+    Suit m_suit = Suit::None;
+    Number m_number = Number::None;
+
+    operator bool() const
+    {
+        return m_suit != Suit::None;
+    }
+};
+
+// A card in one byte: the rank, 1 for ace to 13 for king, in the low four bits
+// and the index of the suit (Suit - 1, also the index of its foundation) in
+// the next two, so bit 5 is set for black cards. 0 is no card.
+//
+// Codes are below 64, so a set of cards is a uint64_t with a bit per code.
+using CardCode = uint8_t;
+
+constexpr int card_rank( CardCode c ) { return c & 0xf; }
+constexpr int card_suit( CardCode c ) { return c >> 4; }
+constexpr bool is_black( CardCode c ) { return c & 0x20; }
+constexpr CardCode make_card( int suit_idx, int rank ) { return suit_idx << 4 | rank; }
+
+// Empty set for no card
+constexpr uint64_t card_bit( CardCode c ) { return static_cast< uint64_t >( c != 0 ) << c; }
+
+inline CardCode card_code( const Card &c )
+{
+    return c ? make_card( static_cast< int >( c.m_suit ) - 1, static_cast< int >( c.m_number ) ) : 0;
+}
+
+inline Card card_from_code( CardCode code )
+{
+    Card c;
+    if ( code )
+    {
+        c.m_suit = static_cast< Suit >( card_suit( code ) + 1 );
+        c.m_number = static_cast< Number >( card_rank( code ) );
+    }
+    return c;
+}
+
+// Cards each card can be put on in a cascade: one rank higher, other color
+constexpr std::array< uint64_t, 64 > make_stacking_targets()
+{
+    std::array< uint64_t, 64 > targets = {};
+    for ( int suit = 0; suit < 4; ++suit )
+    {
+        for ( int rank = 1; rank < 13; ++rank )
+        {
+            for ( int other = 0; other < 4; ++other )
+            {
+                if ( ( suit < 2 ) != ( other < 2 ) )
+                {
+                    targets[ make_card( suit, rank ) ] |= card_bit( make_card( other, rank + 1 ) );
+                }
+            }
+        }
+    }
+    return targets;
+}
+
+inline constexpr std::array< uint64_t, 64 > stacking_targets = make_stacking_targets();
+
+inline bool can_stack( CardCode card, CardCode on )
+{
+    return stacking_targets[ card ] >> on & 1;
+}
+
+// Card that goes next on the foundation of a suit, by the rank on top of it
+// (0 for empty), 0 once the king is there
+constexpr std::array< std::array< CardCode, 14 >, 4 > make_next_foundation_card()
+{
+    std::array< std::array< CardCode, 14 >, 4 > next = {};
+    for ( int suit = 0; suit < 4; ++suit )
+    {
+        for ( int rank = 0; rank < 13; ++rank )
+        {
+            next[ suit ][ rank ] = make_card( suit, rank + 1 );
+        }
+    }
+    return next;
+}
+
+inline constexpr std::array< std::array< CardCode, 14 >, 4 > next_foundation_card = make_next_foundation_card();
+
+struct Cascade
+{
+    std::array< CardCode, 20 > m_cards = {}; // Max number of initial cascade + 12 more cards + null
+    int size = 0;
+};
+
+struct GameState
+{
+    std::array< Cascade, 8 > cascades;
+    std::array< CardCode, 4 > cells = {};
+    std::array< CardCode, 4 > foundations = {}; // Top card of each suit, in suit order
+    uint64_t hash = 0; // Zobrist hash, kept up to date by apply_move/undo_move
+
+    // Also kept up to date by apply_move/undo_move, so that the number of
+    // cards that can be moved at once is known without a scan
+    uint8_t empty_cells = 4;
+    uint8_t empty_cascades = 8;
+
+    // Cards at the bottom of cascades or in cells, the ones that can be moved
+    uint64_t exposed = 0;
+};
+
+enum class Location : uint8_t
+{
+    Cascade,
+    Cell,
+    Foundation,
+};
+
+struct Move
+{
+    Location from = Location::Cascade;
+    uint8_t from_idx = 0;
+    Location to = Location::Cascade;
+    uint8_t to_idx = 0;
+    uint8_t count = 1; // Number of cards moved, only cascade to cascade moves can have more than one
+};
+
+struct MoveList
+{
+    // 8 cascades to up to 7 cascades, or up to 12 run lengths to an empty
+    // cascade, plus 8 to cell, 4*8 from cell, 12 to foundation
+    std::array< Move, 256 > m_moves;
+    int size = 0;
+
+    const Move* begin() const { return m_moves.data(); }
+    const Move* end() const { return m_moves.data() + size; }
+};
+
+// Deals a fresh game for given seed
+void deal( GameState &st, uint64_t seed );
+
+// Recomputes the hash and empty slot counts, for states whose cards were
+// placed directly rather than by moves
+void update_derived( GameState &st );
+
+bool is_full_foundations( const GameState &st );
+
+// Number of cards that can be moved at once as a sequence, using the free
+// cells and empty cascades other than the destination
+inline int max_movable_cards( const GameState &st, bool moving_to_empty_cascade )
+{
+    return ( 1 << ( st.empty_cascades - moving_to_empty_cascade ) ) * ( st.empty_cells + 1 );
+}
+
+// Length of the ordered sequence at the bottom of the cascade
+int movable_run( const Cascade &cascade );
+
+// Cards that can be put on foundations, exposed or not
+inline uint64_t foundation_cards( const GameState &st )
+{
+    return card_bit( next_foundation_card[ 0 ][ card_rank( st.foundations[ 0 ] ) ] )
+         | card_bit( next_foundation_card[ 1 ][ card_rank( st.foundations[ 1 ] ) ] )
+         | card_bit( next_foundation_card[ 2 ][ card_rank( st.foundations[ 2 ] ) ] )
+         | card_bit( next_foundation_card[ 3 ][ card_rank( st.foundations[ 3 ] ) ] );
+}
+
+inline bool can_move_to_foundation( const GameState &st, CardCode c )
+{
+    return c && next_foundation_card[ card_suit( c ) ][ card_rank( st.foundations[ card_suit( c ) ] ) ] == c;
+}
+
+// Completes a move for which only the source and destination are known: fills
+// in the number of cards, and the foundation index when moving to a
+// foundation. Returns false if there is no legal such move.
+//
+// m.count is the most cards wanted, 0 for no limit. Moving to a non empty
+// cascade, the cards there decide how many are moved; moving to an empty one
+// as many as possible are.
+bool resolve_move( const GameState &st, Move &m );
+
+// Generates all legal moves, including every length of sequence that can be
+// moved to an empty cascade. Moves into empty cells or empty cascades only
+// target the first empty one, since the others would lead to equivalent
+// positions.
+void generate_moves( const GameState &st, MoveList &moves );
+
+// Finds a move of a card to its foundation that cannot make the game harder
+// to win: a card is safe to move when every card that could be put on it,
+// the ones a rank lower and of the other color, is already on foundations.
+bool find_safe_move( const GameState &st, Move &m );
+
+// Applies safe moves until there are none left, appending them to moves.
+// Returns the number of moves made.
+int auto_play( GameState &st, MoveList &moves );
+
+// Applies a legal move. Undoing it must be done with the same move, on the
+// state it produced.
+void apply_move( GameState &st, const Move &m );
+void undo_move( GameState &st, const Move &m );
@@ -18,19 +18,89 @@
 #include <algorithm>
 #include <array>
 #include <cctype>
+#include <chrono>
+#include <cerrno>
 #include <csignal>
+#include <cstring>
 #include <functional>
+#include <iomanip>
 #include <iostream>
+#include <memory>
 #include <random>
+#include <string>
 #include <string_view>
+#include <thread>
+#include <vector>
 
+#include <poll.h>
 #include <unistd.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <termios.h>
 
+#include "analyzer.h"
+#include "deal.h"
+#include "engine.h"
+#include "game_log.h"
+#include "hint_worker.h"
+#include "history.h"
+#include "input.h"
+#include "pool.h"
+#include "protocol.h"
+#include "saved_game.h"
+#include "solution_db.h"
+#include "solver.h"
+#include "trace.h"
+
 namespace csi {
 
-thread_local char csi_buf_[ 100 ];
+// Escape sequences for all 256 colors are built at compile time, so setting a
+// color is a table lookup rather than a formatting call.
+struct Sequence
+{
+    char text[ 12 ] = {};
+    uint8_t len = 0;
+
+    constexpr void append( const char *s )
+    {
+        while ( *s )
+        {
+            text[ len++ ] = *s++;
+        }
+    }
+
+    constexpr void append( int n )
+    {
+        if ( n >= 100 ) text[ len++ ] = '0' + n / 100;
+        if ( n >= 10 )  text[ len++ ] = '0' + n / 10 % 10;
+        text[ len++ ] = '0' + n % 10;
+    }
+
+    operator std::string_view() const
+    {
+        return { text, len };
+    }
+};
+
+constexpr std::array< Sequence, 256 > make_color_table( const char *prefix )
+{
+    std::array< Sequence, 256 > table;
+    for ( int color = 0; color < 256; ++color )
+    {
+        table[ color ].append( prefix );
+        table[ color ].append( color );
+        table[ color ].append( "m" );
+    }
+    return table;
+}
+
+constexpr std::array< Sequence, 256 > fg_colors = make_color_table( "\033[38;5;" );
+constexpr std::array< Sequence, 256 > bg_colors = make_color_table( "\033[48;5;" );
 
 auto set_alternate_screen() -> std::string_view
 {
@@ -42,6 +112,28 @@ auto reset_alternate_screen() -> std::string_view
     return "\033[?1049l";
 }
 
+auto enable_bracketed_paste() -> std::string_view
+{
+    return "\033[?2004h";
+}
+
+auto disable_bracketed_paste() -> std::string_view
+{
+    return "\033[?2004l";
+}
+
+// Reports of button presses and releases, in the SGR format that has no
+// limit on coordinates
+auto enable_mouse() -> std::string_view
+{
+    return "\033[?1000h\033[?1006h";
+}
+
+auto disable_mouse() -> std::string_view
+{
+    return "\033[?1006l\033[?1000l";
+}
+
 auto hide_cursor() -> std::string_view
 {
     return "\033[?25l";
@@ -52,22 +144,39 @@ auto show_cursor() -> std::string_view
     return "\033[?25h";
 }
 
+// Writes decimal representation of non-negative n backwards, ending at end
+char* format_int( char *end, int n )
+{
+    do {
+        *--end = '0' + n % 10;
+        n /= 10;
+    } while ( n );
+    return end;
+}
+
+thread_local char csi_buf_[ 32 ];
+
 auto reset_cursor( int row = 1, int col = 1 ) -> std::string_view
 {
-    size_t len = sprintf( csi_buf_, "\033[%d;%dH", row, col );
-    return { csi_buf_, len };
+    char *end = csi_buf_ + sizeof( csi_buf_ );
+    char *p = end;
+    *--p = 'H';
+    p = format_int( p, col );
+    *--p = ';';
+    p = format_int( p, row );
+    *--p = '[';
+    *--p = '\033';
+    return { p, static_cast< size_t >( end - p ) };
 }
 
 auto set_fg_color( int color ) -> std::string_view
 {
-    size_t len = sprintf( csi_buf_, "\033[38;5;%dm", color );
-    return { csi_buf_, len };
+    return fg_colors[ color & 0xFF ];
 }
 
 auto set_bg_color( int color ) -> std::string_view
 {
-    size_t len = sprintf( csi_buf_, "\033[48;5;%dm", color );
-    return { csi_buf_, len };
+    return bg_colors[ color & 0xFF ];
 }
 
 auto set_bright() -> std::string_view
@@ -82,562 +191,1015 @@ auto set_no_bright() -> std::string_view
 
 } // namespace csi
 
-bool starts_with( std::string_view a, std::string_view b )
+struct OutputStats
 {
-    return a.size() >= b.size() && a.substr( 0, b.size() ) == b;
-}
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    uint64_t syscalls = 0;
 
-enum class Suit : uint8_t
-{
-    None,
-    Hearts,
-    Diamonds,
-    Clubs,
-    Spades,
+    size_t last_frame_bytes = 0;
+    int last_frame_syscalls = 0;
 };
 
-std::string_view to_str( const Suit &s )
+// Everything sent to the terminal is collected here and written out with a
+// single write(2) per frame.
+class OutputBuffer
 {
-    switch ( s )
+public:
+    explicit OutputBuffer( size_t capacity = 64 * 1024 )
     {
-    case Suit::Hearts:    return u8"♥";
-    case Suit::Diamonds:  return u8"♦️";
-    case Suit::Clubs:     return u8"♣";
-    case Suit::Spades:    return u8"♠️";
-    default:              return "?";
+        m_buf.reserve( capacity );
     }
-}
 
-int get_color( const Suit &s )
-{
-    switch ( s )
+    OutputBuffer& operator<<( std::string_view s )
     {
-    case Suit::Hearts:    return 196;
-    case Suit::Diamonds:  return 196;
-    case Suit::Clubs:     return 232;
-    case Suit::Spades:    return 232;
-    default:              return 0;
+        m_buf.append( s.data(), s.size() );
+        return *this;
     }
-}
-
-enum class Number : uint8_t
-{
-    None,
-    Ace, Two, Three, Four, Five, Six, Seven, Eight, Nine, Ten, Jack, Queen, King,
-};
-
-std::string_view to_str( const Number &n )
-{
-    static const char* strs[] = {
-        " ?",
-        " A", " 2", " 3", " 4", " 5", " 6", " 7", " 8", " 9", "10", " J", " Q", " K",
-    };
-    return strs[ static_cast< int >( n ) ];
-}
 
-struct Card
-{
-    Suit m_suit = Suit::None;
-    Number m_number = Number::None;
+    OutputBuffer& operator<<( char c )
+    {
+        m_buf.push_back( c );
+        return *this;
+    }
 
-    operator bool() const
+    std::string_view data() const
     {
-        return m_suit != Suit::None;
+        return m_buf;
     }
 
-    int foundation_id() const
+    void clear()
     {
-        return static_cast< int >( m_suit ) - 1;
+        m_buf.clear();
     }
 
-    bool can_move_under( const Card &ot ) const
+    // Removes the first n bytes, once they are written out elsewhere
+    void consume( size_t n )
     {
-        return get_color( this->m_suit ) != get_color( ot.m_suit )
-            && static_cast< int >( this->m_number ) + 1 == static_cast< int >( ot.m_number );
+        m_buf.erase( 0, n );
     }
-};
 
-std::ostream& operator<<( std::ostream &out, const Card &c )
-{
-    out << csi::set_bright()
-        << csi::set_fg_color( get_color( c.m_suit ) ) << " " << to_str( c.m_number ) << to_str( c.m_suit ) << " "
-        << csi::set_no_bright();
+    // Writes and clears the buffered data, returns false on write error
+    bool flush( int fd )
+    {
+        size_t written = 0;
+        int syscalls = 0;
+        while ( written < m_buf.size() )
+        {
+            ssize_t res = write( fd, m_buf.data() + written, m_buf.size() - written );
+            ++syscalls;
+            if ( res < 0 )
+            {
+                if ( errno == EINTR )
+                {
+                    continue;
+                }
+                break;
+            }
+            written += res;
+        }
 
-    return out;
-}
+        ++m_stats.frames;
+        m_stats.bytes += written;
+        m_stats.syscalls += syscalls;
+        m_stats.last_frame_bytes = written;
+        m_stats.last_frame_syscalls = syscalls;
 
-struct Cascade
-{
-    std::array< Card, 20 > m_cards; // Max number of initial cascade + 12 more cards + null
-    int size = 0;
+        bool ok = ( written == m_buf.size() );
+        m_buf.clear();
+        return ok;
+    }
+
+    const OutputStats& stats() const
+    {
+        return m_stats;
+    }
+
+private:
+    std::string m_buf;
+    OutputStats m_stats;
 };
 
-struct GameState
+// A single terminal position. Glyph is the utf-8 encoding of what is shown
+// there, which may include a trailing variation selector.
+struct ScreenCell
 {
-    std::array< Cascade, 8 > cascades;
-    std::array< Card, 4 > cells;
-    std::array< Card, 4 > foundations;
-    bool in_history = false; // Whether we can undo to this state
+    char glyph[ 7 ] = { ' ' };
+    uint8_t glyph_len = 1;
+    uint8_t fg = 0;
+    uint8_t bg = 0;
+    bool bright = false;
 };
 
-// Allows for N-1 levels of undo
-std::array< GameState, 100 > game_states;
-GameState *game = &game_states[ 0 ];
-
-GameState* push_state()
+bool is_blank( const ScreenCell &c )
 {
-    int cur_idx = game - &game_states[ 0 ];
-
-    GameState *new_st = &game_states[ ( cur_idx + 1 ) % game_states.size() ];
-    GameState *end    = &game_states[ ( cur_idx + 2 ) % game_states.size() ];
-
-    *new_st = *game;
-    end->in_history = false;
-    return new_st;
+    return c.glyph_len == 1 && c.glyph[ 0 ] == ' ';
 }
 
-GameState* get_previous_state()
+bool operator==( const ScreenCell &a, const ScreenCell &b )
 {
-    int cur_idx = game - &game_states[ 0 ];
-
-    GameState *prev_st = &game_states[ ( cur_idx + game_states.size() - 1 ) % game_states.size() ];
-
-    if ( prev_st->in_history )
+    if ( a.glyph_len != b.glyph_len || a.bg != b.bg || ! std::equal( a.glyph, a.glyph + a.glyph_len, b.glyph ) )
     {
-        return prev_st;
+        return false;
     }
 
-    return nullptr;
-}
-
-struct winsize term_size;
-int cursor_row = 1;
-int cursor_col = 0;
-
-int selected_row = -1;
-int selected_col = -1;
-
-bool quit_confirmation = false;
-bool help_screen = false;
-bool running = true;
-
-uint64_t game_seed;
-
-Cascade& from_cascade()
-{
-    return game->cascades[ selected_col ];
+    // Foreground attributes are invisible on blanks
+    return is_blank( a ) || ( a.fg == b.fg && a.bright == b.bright );
 }
 
-Cascade& to_cascade()
+bool operator!=( const ScreenCell &a, const ScreenCell &b )
 {
-    return game->cascades[ cursor_col ];
+    return ! ( a == b );
 }
 
-int max_movable_cards( bool moving_to_empty_cascade )
+// Frames are drawn into the back buffer, then flush() sends only the cells
+// that differ from the front buffer (what the terminal currently shows).
+class Screen
 {
-    int empty_cascade_cnt = 0;
-    for ( int i = 0; i < 8; ++i )
+public:
+    void resize( int rows, int cols )
     {
-        empty_cascade_cnt += ( game->cascades[ i ].size == 0 );
+        m_rows = rows;
+        m_cols = cols;
+        m_back.assign( rows * cols, ScreenCell() );
+        m_front.assign( rows * cols, ScreenCell() );
+        invalidate();
     }
 
-    int empty_cell_cnt = 0;
-    for ( int i = 0; i < 4; ++i )
+    int rows() const { return m_rows; }
+    int cols() const { return m_cols; }
+
+    // Forget what the terminal shows, so that next flush repaints everything
+    void invalidate()
     {
-        empty_cell_cnt += ( ! game->cells[ i ] );
+        for ( ScreenCell &c : m_front )
+        {
+            c.glyph_len = 0;
+        }
     }
 
-    if ( moving_to_empty_cascade )
+    void clear( int bg )
     {
-        return ( 1 << ( empty_cascade_cnt - 1 ) ) * ( empty_cell_cnt + 1 );
+        ScreenCell blank;
+        blank.bg = bg;
+        std::fill( m_back.begin(), m_back.end(), blank );
     }
-    else
+
+    void set_fg_color( int color ) { m_fg = color; }
+    void set_bg_color( int color ) { m_bg = color; }
+    void set_bright( bool bright ) { m_bright = bright; }
+
+    // Row and col are 1 based, same as csi::reset_cursor
+    void print( int row, int col, std::string_view text )
     {
-        return ( 1 << ( empty_cascade_cnt ) ) * ( empty_cell_cnt + 1 );
+        m_row = row - 1;
+        m_col = col - 1;
+        print( text );
     }
-}
-
-// TODO calculation for movable card count is not done yet
-// TODO add shortcut to send all available to foundations
-void try_move()
-{
-    // Tries to move from seleected to cursor
 
-    if ( selected_row == 1 && cursor_row == 1 )
+    // Continues from where the last print left off
+    void print( std::string_view text )
     {
-        // TODO whem moving to empty cascade, this moves all available items, which is not always desired
-        if ( to_cascade().size == 0 )
+        ScreenCell *last = nullptr;
+
+        while ( text.size() )
         {
-            int num_cards = 1;
+            size_t len = utf8_len( text[ 0 ] );
+            len = std::min( len, text.size() );
+            std::string_view glyph = text.substr( 0, len );
+            text = text.substr( len );
 
-            while ( num_cards < from_cascade().size && from_cascade().m_cards[ from_cascade().size - num_cards ].can_move_under( from_cascade().m_cards[ from_cascade().size - num_cards - 1 ] ) )
+            if ( glyph == u8"\uFE0F" )
             {
-                ++num_cards;
+                // Variation selector belongs to the previous glyph
+                if ( last && last->glyph_len + len <= sizeof( last->glyph ) )
+                {
+                    std::copy( glyph.begin(), glyph.end(), last->glyph + last->glyph_len );
+                    last->glyph_len += len;
+                }
+                continue;
             }
 
-            if ( num_cards > max_movable_cards( true ) )
+            last = nullptr;
+            if ( m_row >= 0 && m_row < m_rows && m_col >= 0 && m_col < m_cols )
             {
-                return;
+                last = &m_back[ m_row * m_cols + m_col ];
+                std::copy( glyph.begin(), glyph.end(), last->glyph );
+                last->glyph_len = len;
+                last->fg = m_fg;
+                last->bg = m_bg;
+                last->bright = m_bright;
             }
+            ++m_col;
+        }
+    }
 
-            game = push_state();
+    void flush( OutputBuffer &out );
 
+private:
+    static size_t utf8_len( char lead )
+    {
+        unsigned char c = lead;
+        return c < 0x80 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+    }
 
-            std::copy( from_cascade().m_cards.begin() + from_cascade().size - num_cards,
-                       from_cascade().m_cards.begin() + from_cascade().size,
-                       to_cascade().m_cards.begin() + to_cascade().size );
+    int m_rows = 0;
+    int m_cols = 0;
+    std::vector< ScreenCell > m_back;
+    std::vector< ScreenCell > m_front;
+
+    // Pen used by print()
+    int m_row = 0;
+    int m_col = 0;
+    uint8_t m_fg = 0;
+    uint8_t m_bg = 0;
+    bool m_bright = false;
+};
 
-            from_cascade().size -= num_cards;
-            to_cascade().size += num_cards;
-            selected_row = -1;
-            selected_col = -1;
-            return;
-        }
+void Screen::flush( OutputBuffer &out )
+{
+    // Terminal state as known by us, -1 is unknown
+    int cur_row = -1;
+    int cur_col = -1;
+    int cur_fg = -1;
+    int cur_bg = -1;
+    int cur_bright = -1;
+
+    auto pen_matches = [ & ]( const ScreenCell &c )
+    {
+        return c.bg == cur_bg && ( is_blank( c ) || ( c.fg == cur_fg && c.bright == cur_bright ) );
+    };
 
-        // move from one cascade to another
-        for ( int num_cards = 1; num_cards <= from_cascade().size ; ++num_cards )
+    for ( int row = 0; row < m_rows; ++row )
+    {
+        for ( int col = 0; col < m_cols; ++col )
         {
-            if ( num_cards > 1 )
+            ScreenCell &back = m_back[ row * m_cols + col ];
+            ScreenCell &front = m_front[ row * m_cols + col ];
+
+            if ( back == front )
+            {
+                continue;
+            }
+
+            if ( cur_row != row || cur_col != col )
             {
-                if ( ! from_cascade().m_cards[ from_cascade().size - num_cards + 1 ].can_move_under( from_cascade().m_cards[ from_cascade().size - num_cards ] ) )
+                // For short gaps rewriting unchanged cells is cheaper than moving the cursor
+                int gap = col - cur_col;
+                bool rewrite = ( cur_row == row && gap > 0 && gap <= 4 );
+                for ( int i = cur_col; rewrite && i < col; ++i )
+                {
+                    const ScreenCell &c = m_front[ row * m_cols + i ];
+                    rewrite = ( c.glyph_len == 1 && pen_matches( c ) );
+                }
+
+                if ( rewrite )
+                {
+                    for ( int i = cur_col; i < col; ++i )
+                    {
+                        out << m_front[ row * m_cols + i ].glyph[ 0 ];
+                    }
+                }
+                else
                 {
-                    break;
+                    out << csi::reset_cursor( row + 1, col + 1 );
                 }
             }
 
-            if ( num_cards > max_movable_cards( false ) )
+            if ( back.bg != cur_bg )
             {
-                return;
+                out << csi::set_bg_color( back.bg );
+                cur_bg = back.bg;
             }
 
-            if ( from_cascade().m_cards[ from_cascade().size - num_cards ].can_move_under( to_cascade().m_cards[ to_cascade().size - 1 ] ) )
+            if ( ! is_blank( back ) )
             {
-                game = push_state();
+                if ( back.fg != cur_fg )
+                {
+                    out << csi::set_fg_color( back.fg );
+                    cur_fg = back.fg;
+                }
+                if ( back.bright != cur_bright )
+                {
+                    out << ( back.bright ? csi::set_bright() : csi::set_no_bright() );
+                    cur_bright = back.bright;
+                }
+            }
 
-                std::copy( from_cascade().m_cards.begin() + from_cascade().size - num_cards,
-                           from_cascade().m_cards.begin() + from_cascade().size,
-                           to_cascade().m_cards.begin() + to_cascade().size );
+            out << std::string_view( back.glyph, back.glyph_len );
+            front = back;
 
-                from_cascade().size -= num_cards;
-                to_cascade().size += num_cards;
-                selected_row = -1;
-                selected_col = -1;
-                break;
+            cur_row = row;
+            cur_col = col + 1;
+
+            // Wide glyphs and the pending wrap at the last column leave cursor position uncertain
+            if ( back.glyph_len > 3 || cur_col == m_cols )
+            {
+                cur_row = -1;
             }
         }
     }
-    else if ( selected_row == 1 && cursor_row == 0 )
+}
+
+bool starts_with( std::string_view a, std::string_view b )
+{
+    return a.size() >= b.size() && a.substr( 0, b.size() ) == b;
+}
+
+std::string_view to_str( const Suit &s )
+{
+    switch ( s )
     {
-        if ( game->cells[ cursor_col ] )
-        {
-            return;
-        }
+    case Suit::Hearts:    return u8"♥";
+    case Suit::Diamonds:  return u8"♦️";
+    case Suit::Clubs:     return u8"♣";
+    case Suit::Spades:    return u8"♠️";
+    default:              return "?";
+    }
+}
 
-        game = push_state();
-        game->cells[ cursor_col ] = from_cascade().m_cards[ from_cascade().size-- - 1 ];
-        selected_row = -1;
-        selected_col = -1;
-        return;
+int get_color( const Suit &s )
+{
+    switch ( s )
+    {
+    case Suit::Hearts:    return 196;
+    case Suit::Diamonds:  return 196;
+    case Suit::Clubs:     return 232;
+    case Suit::Spades:    return 232;
+    default:              return 0;
     }
-    else if ( selected_row == 0 && cursor_row == 1 )
+}
+
+std::string_view to_str( const Number &n )
+{
+    static const char* strs[] = {
+        " ?",
+        " A", " 2", " 3", " 4", " 5", " 6", " 7", " 8", " 9", "10", " J", " Q", " K",
+    };
+    return strs[ static_cast< int >( n ) ];
+}
+
+std::string to_str( const Move &m )
+{
+    auto loc_str = []( Location loc, int idx ) -> char
     {
-        if ( to_cascade().size == 0 || game->cells[ selected_col ].can_move_under( to_cascade().m_cards[ to_cascade().size - 1 ] ) )
+        switch ( loc )
         {
-            game = push_state();
-
-            to_cascade().m_cards[ to_cascade().size++ ] = game->cells[ selected_col ];
-            game->cells[ selected_col ].m_suit = Suit::None;
-            selected_row = -1;
-            selected_col = -1;
-            return;
+        case Location::Cascade:    return '1' + idx;
+        case Location::Cell:       return 'a' + idx;
+        case Location::Foundation: return 'h';
         }
-    }
+        return '?';
+    };
+
+    return { loc_str( m.from, m.from_idx ), loc_str( m.to, m.to_idx ) };
 }
 
-bool try_move_to_foundation( const Card &c )
+// Where things are drawn, for a given terminal width. Mouse clicks are
+// mapped back to cards with the same numbers.
+struct Layout
 {
-    if ( !c )
-    {
-        return false;
-    }
+    static constexpr int cascade_width = 8;
+    static constexpr int card_width = 5;
+    static constexpr int card_height = 4;
+
+    static constexpr int frame_height = 48;
+    static constexpr int frame_width = 8 * cascade_width + 3;
+    static constexpr int frame_start_row = 1;
+    static constexpr int top_row = frame_start_row + 6; // Top of cascades
 
-    if ( c.m_number == Number::Ace
-      || static_cast< int >( c.m_number ) == static_cast< int >( game->foundations[ c.foundation_id() ].m_number ) + 1 )
+    int frame_start_col = 0;
+    int start_col = 0; // Left of first cascade
+
+    explicit Layout( int term_cols = 0 )
+        : frame_start_col( ( term_cols - frame_width ) / 2 )
+        , start_col( frame_start_col + 3 )
     {
-        game = push_state();
-        game->foundations[ c.foundation_id() ] = c;
-        return true;
     }
 
-    return false;
-}
+    int cell_col( int idx ) const { return frame_start_col + 2 + 7 * idx; }
+    int foundation_col( int idx ) const { return frame_start_col + frame_width - 7 - 7 * idx; }
+    int cascade_col( int idx ) const { return start_col + cascade_width * idx; }
+};
 
-void try_move_to_foundation()
+// What is at a position on the screen
+struct Hit
 {
-    if ( cursor_row == 0 )
+    Location loc = Location::Cascade;
+    int idx = -1;  // -1 if nothing
+    int card = -1; // Index of the card in a cascade, -1 below the cards
+};
+
+// Finds what is under the mouse in constant time: the slot at each column
+// is kept in a table, rebuilt when the layout changes, and the card in a
+// cascade follows from the row.
+class HitMap
+{
+public:
+    void build( const Layout &layout, int term_cols )
     {
-        if ( try_move_to_foundation( game->cells[ cursor_col ] ) )
+        m_top.assign( std::max( term_cols, 0 ), -1 );
+        m_cascades.assign( std::max( term_cols, 0 ), -1 );
+
+        auto mark = [ & ]( std::vector< int8_t > &table, int col, int val )
+        {
+            for ( int i = std::max( col, 0 ); i < std::min( col + Layout::card_width, term_cols ); ++i )
+            {
+                table[ i ] = val;
+            }
+        };
+
+        for ( int i = 0; i < 4; ++i )
+        {
+            mark( m_top, layout.cell_col( i ), i );
+            mark( m_top, layout.foundation_col( i ), 4 + i );
+        }
+        for ( int i = 0; i < 8; ++i )
         {
-            game->cells[ cursor_col ].m_suit = Suit::None;
+            mark( m_cascades, layout.cascade_col( i ), i );
         }
     }
-    else // Cursor row == 1
+
+    Hit hit( const GameState &st, int row, int col ) const
     {
-        if ( game->cascades[ cursor_col ].size == 0 )
+        Hit h;
+        if ( col < 0 || col >= static_cast< int >( m_top.size() ) )
         {
-            return;
+            return h;
         }
 
-        if ( try_move_to_foundation( game->cascades[ cursor_col ].m_cards[ game->cascades[ cursor_col ].size - 1 ] ) )
+        const int top = Layout::frame_start_row + 1;
+        if ( row >= top && row < top + Layout::card_height && m_top[ col ] >= 0 )
         {
-            game->cascades[ cursor_col ].size--;
-
-            if ( selected_row == 1 && selected_col == cursor_col )
-            {
-                // Deselect if selected element is sent to foundation
-                selected_row = -1;
-                selected_col = -1;
-            }
+            h.loc = ( m_top[ col ] < 4 ? Location::Cell : Location::Foundation );
+            h.idx = m_top[ col ] % 4;
         }
+        else if ( row >= Layout::top_row && row < Layout::frame_start_row + Layout::frame_height - 1 && m_cascades[ col ] >= 0 )
+        {
+            // Each card shows two rows, except the last one which shows all
+            const Cascade &cascade = st.cascades[ m_cascades[ col ] ];
+            const int card = ( row - Layout::top_row ) / 2;
+            const int last = cascade.size - 1;
+            h.loc = Location::Cascade;
+            h.idx = m_cascades[ col ];
+            h.card = ( card < last || row < Layout::top_row + 2 * last + Layout::card_height ? std::min( card, last ) : -1 );
+        }
+        return h;
     }
-}
 
-// Beware of above/below distinction, since cards above are rendered below in the terminal..
-enum CardAttr
-{
-    HasCardAbove = 1,
-    HasCardBelow = 2,
-    Selected = 4,
-    EmptySlot = 8,
+private:
+    std::vector< int8_t > m_top;      // Cell 0-3 or foundation 4-7 at each column
+    std::vector< int8_t > m_cascades; // Cascade at each column
 };
 
-void draw_card( const Card &c, int row, int col, int attrs = 0 )
+GameLogWriter game_log; // Only open with --log
+std::unique_ptr< HintWorker > hints; // Only while playing
+
+// Precomputed results, only open with --solution-db
+SolutionDb solution_db;
+
+// Everything about the game on screen and the terminal it is in, with the
+// values a new game starts with. The UI code reaches it through player: a
+// local game has its own, and a game server points player at the state of
+// the session it is handling.
+struct PlayerState
 {
-    if ( attrs & CardAttr::EmptySlot )
-    {
-        std::cout << csi::set_bg_color( 247 ) << csi::set_fg_color( 28 )
-                  << csi::reset_cursor( row,     col ) << u8"▀▀▀▀▀"
-                  << csi::reset_cursor( row + 1, col ) << u8"     "
-                  << csi::reset_cursor( row + 2, col ) << u8"     "
-                  << csi::reset_cursor( row + 3, col ) << u8"▄▄▄▄▄";
-        return;
-    }
+    OutputBuffer term_out{ 4096 };
+    Screen screen;
+    GameState game;
+    History history;
+    bool show_hints = true;
 
+    SolutionDb::Result known_result; // For the deal being played
 
-    std::cout << csi::set_bg_color( 255 );
+    // Positions along the known solution, before each of its moves, and the
+    // one on screen if it is among them
+    std::vector< PackedState > known_path;
+    int known_step = -1;
 
-    if ( attrs & CardAttr::Selected )
-    {
-        std::cout << csi::set_fg_color( 202 ) << csi::reset_cursor( row, col - 1 ) << u8"█▀▀▀▀▀█";
-    }
-    else if ( attrs & CardAttr::HasCardBelow )
+    struct winsize term_size = {};
+    int cursor_row = 1;
+    int cursor_col = 0;
+
+    int selected_row = -1;
+    int selected_col = -1;
+    int selected_count = 1; // Number of cards selected at the bottom of a cascade
+
+    bool quit_confirmation = false;
+    bool help_screen = false;
+    bool running = true;
+
+    uint64_t game_seed = 0;
+    bool ms_deal = false; // Whether game_seed is a Microsoft deal number
+
+    Layout layout;
+    HitMap hit_map;
+    int layout_cols = -1; // Terminal width layout is for
+
+    Hit mouse_press; // Where a button went down, idx -1 if none is down
+    uint8_t mouse_button = 0;
+
+    InputDecoder input_decoder;
+};
+
+PlayerState local_player;
+PlayerState *player = &local_player; // The one being played
+
+// Called after every change to the position on screen
+void game_changed()
+{
+    player->known_step = -1;
+    if ( ! player->known_path.empty() )
     {
-        std::cout << csi::set_fg_color( 248 ) << csi::reset_cursor( row, col ) << u8"─────";
+        const PackedState packed = pack( player->game );
+        auto it = std::find( player->known_path.begin(), player->known_path.end(), packed );
+        player->known_step = ( it == player->known_path.end() ? -1 : it - player->known_path.begin() );
     }
-    else
+
+    // Only search what the database does not answer
+    if ( hints && player->known_step < 0 && player->known_result.status != DealStatus::Unsolvable )
     {
-        std::cout << csi::set_fg_color( 28 ) << csi::reset_cursor( row, col ) << u8"▀▀▀▀▀";
+        hints->request( player->game );
     }
+}
 
-    if ( attrs & CardAttr::Selected )
+HintWorker::Hint current_hint()
+{
+    HintWorker::Hint hint;
+    if ( player->known_result.status == DealStatus::Unsolvable )
     {
-        std::cout << csi::set_fg_color( 202 ) << csi::reset_cursor( row + 1, col - 1 ) << u8"█";
+        hint.status = HintWorker::Status::DeadEnd;
     }
-    std::cout << csi::reset_cursor( row + 1, col ) << c;
-    if ( attrs & CardAttr::Selected )
+    else if ( player->known_step >= 0 )
     {
-        std::cout << csi::set_fg_color( 202 ) << csi::reset_cursor( row + 1, col + 5 ) << u8"█";
+        hint.status = HintWorker::Status::Solvable;
+        hint.move = decode_move( player->known_result.moves[ player->known_step ] );
     }
-
-    if ( attrs & CardAttr::HasCardAbove )
+    else if ( hints )
     {
-        return;
+        hint = hints->result();
     }
+    return hint;
+}
 
-    if ( attrs & CardAttr::Selected )
+bool solve_mode = false;
+bool analyze_mode = false;
+int solve_threads = 1;
+
+// Where the game in progress is kept between runs, empty for nowhere
+std::string save_path;
+
+void deal_game( GameState &st )
+{
+    if ( player->ms_deal )
     {
-        std::cout << csi::set_fg_color( 202 )
-                  << csi::reset_cursor( row + 2, col - 1 ) << u8"█     █"
-                  << csi::reset_cursor( row + 3, col - 1 ) << u8"█▄▄▄▄▄█";
+        deal_ms( st, player->game_seed );
     }
     else
     {
-        std::cout << csi::set_fg_color( 28 )
-                  << csi::reset_cursor( row + 2, col ) << u8"     "
-                  << csi::reset_cursor( row + 3, col ) << u8"▄▄▄▄▄";
+        deal( st, player->game_seed );
     }
 }
 
-bool is_full_foundations( GameState* game )
+std::string game_name()
 {
-        if ( game->foundations[0].m_number == Number::King && game->foundations[1].m_number == Number::King
-                && game->foundations[2].m_number == Number::King && game->foundations[3].m_number == Number::King )
-                return true;
-        else
-                return false;
+    return ( player->ms_deal ? "Deal = " : "Seed = " ) + std::to_string( player->game_seed );
 }
 
-void draw_frame()
+// Looks the deal up in the solution database. The solution is replayed the
+// way a game log is, so a damaged file cannot lead to an illegal hint.
+void load_known_solution()
+{
+    player->known_result = solution_db.lookup( player->game_seed, player->ms_deal );
+    player->known_path.clear();
+
+    GameState st;
+    History hist;
+    deal_game( st );
+    hist.reset( st );
+    for ( size_t i = 0; i < player->known_result.num_moves; ++i )
+    {
+        player->known_path.push_back( pack( st ) );
+        if ( ! apply_record( player->known_result.moves[ i ], st, hist ) )
+        {
+            player->known_result = SolutionDb::Result();
+            player->known_path.clear();
+            return;
+        }
+    }
+}
+
+// Sends the cards nothing can be put on any more to foundations, undone
+// together with the last move
+void auto_play_game()
+{
+    if ( player->history.auto_play( player->game ) )
+    {
+        game_log.write_auto_play();
+    }
+}
+
+void play_move( const Move &m )
+{
+    player->history.apply( player->game, m );
+    TRACE( Info, Move, encode_move( m ), player->history.position() );
+    game_log.write_move( m );
+    auto_play_game();
+    game_changed();
+}
+
+// Tries to move the selected cards to the given place
+bool try_move_to( Location to, int to_idx )
+{
+    Move m;
+    m.from = ( player->selected_row == 0 ? Location::Cell : Location::Cascade );
+    m.from_idx = player->selected_col;
+    m.to = to;
+    m.to_idx = to_idx;
+    m.count = player->selected_count;
+
+    if ( ! resolve_move( player->game, m ) )
+    {
+        TRACE( Debug, MoveRejected, encode_move( m ), 0 );
+        return false;
+    }
+
+    play_move( m );
+    player->selected_row = -1;
+    player->selected_col = -1;
+    return true;
+}
+
+void try_move()
+{
+    // Tries to move from selected to cursor
+    try_move_to( player->cursor_row == 0 ? Location::Cell : Location::Cascade, player->cursor_col );
+}
+
+void try_move_to_foundation()
+{
+    Move m;
+    m.from = ( player->cursor_row == 0 ? Location::Cell : Location::Cascade );
+    m.from_idx = player->cursor_col;
+    m.to = Location::Foundation;
+
+    if ( ! resolve_move( player->game, m ) )
+    {
+        TRACE( Debug, MoveRejected, encode_move( m ), 0 );
+        return;
+    }
+
+    // Cards at the selected place, which the move or the auto play after it
+    // may take to foundations too
+    auto selected_cards = []
+    {
+        return player->selected_row == 0 ? ( player->game.cells[ player->selected_col ] ? 1 : 0 ) : player->game.cascades[ player->selected_col ].size;
+    };
+    const int before = ( player->selected_row == -1 ? 0 : selected_cards() );
+
+    play_move( m );
+
+    if ( player->selected_row != -1 && selected_cards() != before )
+    {
+        // Deselect if selected cards are sent to foundation
+        player->selected_row = -1;
+        player->selected_col = -1;
+    }
+}
+
+// Beware of above/below distinction, since cards above are rendered below in the terminal..
+enum CardAttr
+{
+    HasCardAbove = 1,
+    HasCardBelow = 2,
+    Selected = 4,
+    EmptySlot = 8,
+    SelectedBelow = 16, // Card below is selected too
+
+};
+
+void draw_card( const Card &c, int row, int col, int attrs = 0 )
+{
+    if ( attrs & CardAttr::EmptySlot )
+    {
+        player->screen.set_bg_color( 247 );
+        player->screen.set_fg_color( 28 );
+        player->screen.print( row,     col, u8"▀▀▀▀▀" );
+        player->screen.print( row + 1, col, u8"     " );
+        player->screen.print( row + 2, col, u8"     " );
+        player->screen.print( row + 3, col, u8"▄▄▄▄▄" );
+        return;
+    }
+
+
+    player->screen.set_bg_color( 255 );
+
+    if ( attrs & CardAttr::SelectedBelow )
+    {
+        player->screen.set_fg_color( 202 );
+        player->screen.print( row, col - 1, u8"█" );
+        player->screen.set_fg_color( 248 );
+        player->screen.print( u8"─────" );
+        player->screen.set_fg_color( 202 );
+        player->screen.print( u8"█" );
+    }
+    else if ( attrs & CardAttr::Selected )
+    {
+        player->screen.set_fg_color( 202 );
+        player->screen.print( row, col - 1, u8"█▀▀▀▀▀█" );
+    }
+    else if ( attrs & CardAttr::HasCardBelow )
+    {
+        player->screen.set_fg_color( 248 );
+        player->screen.print( row, col, u8"─────" );
+    }
+    else
+    {
+        player->screen.set_fg_color( 28 );
+        player->screen.print( row, col, u8"▀▀▀▀▀" );
+    }
+
+    if ( attrs & CardAttr::Selected )
+    {
+        player->screen.set_fg_color( 202 );
+        player->screen.print( row + 1, col - 1, u8"█" );
+    }
+    player->screen.set_bright( true );
+    player->screen.set_fg_color( get_color( c.m_suit ) );
+    player->screen.print( row + 1, col, " " );
+    player->screen.print( to_str( c.m_number ) );
+    player->screen.print( to_str( c.m_suit ) );
+    player->screen.print( " " );
+    player->screen.set_bright( false );
+    if ( attrs & CardAttr::Selected )
+    {
+        player->screen.set_fg_color( 202 );
+        player->screen.print( row + 1, col + 5, u8"█" );
+    }
+
+    if ( attrs & CardAttr::HasCardAbove )
+    {
+        return;
+    }
+
+    if ( attrs & CardAttr::Selected )
+    {
+        player->screen.set_fg_color( 202 );
+        player->screen.print( row + 2, col - 1, u8"█     █" );
+        player->screen.print( row + 3, col - 1, u8"█▄▄▄▄▄█" );
+    }
+    else
+    {
+        player->screen.set_fg_color( 28 );
+        player->screen.print( row + 2, col, u8"     " );
+        player->screen.print( row + 3, col, u8"▄▄▄▄▄" );
+    }
+}
+
+// Draws the frame into term_out
+void render_frame()
 {
+    if ( player->screen.rows() != player->term_size.ws_row || player->screen.cols() != player->term_size.ws_col )
+    {
+        player->screen.resize( player->term_size.ws_row, player->term_size.ws_col );
+    }
+
+    if ( player->layout_cols != player->term_size.ws_col )
+    {
+        player->layout_cols = player->term_size.ws_col;
+        player->layout = Layout( player->layout_cols );
+        player->hit_map.build( player->layout, player->layout_cols );
+    }
+
     // Clear screen first
-    std::cout << csi::set_bg_color( 232 );
-    for ( int i = 0; i < term_size.ws_row * term_size.ws_col; ++i )
-        std::cout << " ";
+    player->screen.clear( 232 );
 
-    const int cascade_width = 8;
+    const int cascade_width = Layout::cascade_width;
 
-    const int frame_height = 48;
-    const int frame_width = 8 * cascade_width + 3;
-    const int frame_start_row = 1;
-    const int frame_start_col = ( term_size.ws_col - frame_width ) / 2;
+    const int frame_height = Layout::frame_height;
+    const int frame_width = Layout::frame_width;
+    const int frame_start_row = Layout::frame_start_row;
+    const int frame_start_col = player->layout.frame_start_col;
 
     // Draw frame
-    std::cout << csi::set_bg_color( 28 ) << csi::set_fg_color( 255 );
+    player->screen.set_bg_color( 28 );
+    player->screen.set_fg_color( 255 );
     for ( int row = 0; row < frame_height; ++row )
     {
-        std::cout << csi::reset_cursor( frame_start_row + row, frame_start_col );
-
-        std::cout << ( row ==  0 ? u8"┌" :
-                       row == frame_height - 1 ? u8"└" : "│" );
+        player->screen.print( frame_start_row + row, frame_start_col,
+                      row ==  0 ? u8"┌" :
+                      row == frame_height - 1 ? u8"└" : "│" );
 
         for ( int col = 1; col < frame_width - 1; ++col )
         {
-            std::cout << ( ( row ==  0 || row == frame_height - 1 ) ? u8"─" : " " );
+            player->screen.print( ( row ==  0 || row == frame_height - 1 ) ? u8"─" : " " );
         }
 
-        std::cout << ( row ==  0 ? u8"┐" :
-                       row == frame_height - 1 ? u8"┘" : "│" );
+        player->screen.print( row ==  0 ? u8"┐" :
+                      row == frame_height - 1 ? u8"┘" : "│" );
     }
 
-    std::cout << csi::set_bg_color( 28 ) << csi::set_fg_color( 42 )
-              << csi::reset_cursor( frame_start_row + 2, frame_start_col + 29 ) << " F R E E "
-              << csi::reset_cursor( frame_start_row + 3, frame_start_col + 29 ) << " C E L L ";
+    player->screen.set_bg_color( 28 );
+    player->screen.set_fg_color( 42 );
+    player->screen.print( frame_start_row + 2, frame_start_col + 29, " F R E E " );
+    player->screen.print( frame_start_row + 3, frame_start_col + 29, " C E L L " );
 
     {
         for ( int cell_idx = 0; cell_idx < 4; ++cell_idx )
         {
             int attrs = 0;
-            attrs |= ( game->cells[ cell_idx ] ? 0 : CardAttr::EmptySlot );
-            attrs |= ( selected_row == 0 && selected_col == cell_idx ? CardAttr::Selected : 0 );
-            draw_card( game->cells[ cell_idx ], frame_start_row + 1, frame_start_col +  2 + 7 * cell_idx, attrs );
+            attrs |= ( player->game.cells[ cell_idx ] ? 0 : CardAttr::EmptySlot );
+            attrs |= ( player->selected_row == 0 && player->selected_col == cell_idx ? CardAttr::Selected : 0 );
+            draw_card( card_from_code( player->game.cells[ cell_idx ] ), frame_start_row + 1, player->layout.cell_col( cell_idx ), attrs );
         }
 
-        if ( cursor_row == 0 )
+        if ( player->cursor_row == 0 )
         {
-            std::cout << csi::set_bg_color( 28 )
-                      << csi::set_fg_color( 202 )
-                      << csi::reset_cursor( frame_start_row + 5, frame_start_col + 1 + 7 * cursor_col ) << u8"└─────┘";
+            player->screen.set_bg_color( 28 );
+            player->screen.set_fg_color( 202 );
+            player->screen.print( frame_start_row + 5, frame_start_col + 1 + 7 * player->cursor_col, u8"└─────┘" );
         }
 
         for ( int cell_idx = 0; cell_idx < 4; ++cell_idx )
         {
-            int attrs = ( game->foundations[ cell_idx ] ? 0 : CardAttr::EmptySlot );
+            int attrs = ( player->game.foundations[ cell_idx ] ? 0 : CardAttr::EmptySlot );
             int row = frame_start_row + 1;
-            int col = frame_start_col + frame_width - 7 - cell_idx * 7;
-            draw_card( game->foundations[ cell_idx ], row, col, attrs );
+            int col = player->layout.foundation_col( cell_idx );
+            draw_card( card_from_code( player->game.foundations[ cell_idx ] ), row, col, attrs );
 
             if ( attrs & CardAttr::EmptySlot )
             {
                 Suit s = static_cast< Suit >( cell_idx + 1 );
-                std::cout << csi::reset_cursor( row + 1, col + 2 )
-                          << csi::set_bg_color( 247 )
-                          << csi::set_fg_color( get_color( s ) )
-                          << to_str( s );
+                player->screen.set_bg_color( 247 );
+                player->screen.set_fg_color( get_color( s ) );
+                player->screen.print( row + 1, col + 2, to_str( s ) );
             }
         }
     }
 
 
-    const int top_row = frame_start_row + 6;
-    const int start_col = frame_start_col + 3;
+    const int top_row = Layout::top_row;
+    const int start_col = player->layout.start_col;
 
     for ( int c_idx = 0; c_idx < 8; ++c_idx )
     {
-        std::cout << csi::set_bg_color( 255 ); // white bg for cards
-
-        const Cascade &cascade = game->cascades[ c_idx ];
+        const Cascade &cascade = player->game.cascades[ c_idx ];
 
         int row = top_row;
-        int col = start_col + cascade_width * c_idx;
+        int col = player->layout.cascade_col( c_idx );
 
-        if ( cascade.m_cards[ 0 ].m_suit == Suit::None )
+        if ( cascade.size == 0 )
         {
-            std::cout << csi::reset_cursor( row, col ) << csi::set_fg_color( 25 ) << "<...>";
+            player->screen.set_bg_color( 255 );
+            player->screen.set_fg_color( 25 );
+            player->screen.print( row, col, "<...>" );
         }
         else
         {
             for ( int card_idx = 0; card_idx < cascade.size ; ++card_idx )
             {
-                const Card &card = cascade.m_cards[ card_idx ];
+                const Card card = card_from_code( cascade.m_cards[ card_idx ] );
 
                 int attrs = 0;
                 attrs |= ( card_idx < cascade.size - 1 ? CardAttr::HasCardAbove : 0 );
                 attrs |= ( card_idx > 0 ? CardAttr::HasCardBelow : 0 );
-                attrs |= ( card_idx == cascade.size - 1 && selected_row == 1 && selected_col == c_idx ? CardAttr::Selected : 0 );
+                if ( player->selected_row == 1 && player->selected_col == c_idx && card_idx >= cascade.size - player->selected_count )
+                {
+                    attrs |= CardAttr::Selected;
+                    attrs |= ( card_idx > cascade.size - player->selected_count ? CardAttr::SelectedBelow : 0 );
+                }
 
                 draw_card( card, row + 2 * card_idx, col, attrs );
             }
         }
     }
 
-    if ( cursor_row == 1 )
+    if ( player->cursor_row == 1 )
     {
         int row = top_row;
-        int col = start_col + cascade_width * cursor_col;
+        int col = start_col + cascade_width * player->cursor_col;
 
-        std::cout << csi::set_bg_color( 28 )
-                  << csi::set_fg_color( 202 )
-                  << csi::reset_cursor( row + 2 + 2 * game->cascades[ cursor_col ].size, col - 1 ) << u8"└─────┘";
+        player->screen.set_bg_color( 28 );
+        player->screen.set_fg_color( 202 );
+        player->screen.print( row + 2 + 2 * player->game.cascades[ player->cursor_col ].size, col - 1, u8"└─────┘" );
     }
 
-    if ( quit_confirmation )
+    if ( player->quit_confirmation )
     {
-        if( is_full_foundations( game ) )
-	    {
-		    std::cout << csi::set_bg_color( 235 ) << csi::set_fg_color( 255 )
-			          << csi::set_bright()
-			          << csi::reset_cursor( top_row + 14, start_col + 23) << "      WIN      "
-		     	      << csi::set_no_bright();
-	    }
-        std::cout << csi::set_bg_color( 196 ) << csi::set_fg_color( 255 )
-                  << csi::set_bright()
-                  << csi::reset_cursor( top_row + 15, start_col + 23 ) << "               "
-                  << csi::reset_cursor( top_row + 16, start_col + 23 ) << "  QUIT? (y/n)  "
-                  << csi::reset_cursor( top_row + 17, start_col + 23 ) << "               "
-                  << csi::set_no_bright();
+        player->screen.set_bright( true );
+        if( is_full_foundations( player->game ) )
+        {
+            player->screen.set_bg_color( 235 );
+            player->screen.set_fg_color( 255 );
+            player->screen.print( top_row + 14, start_col + 23, "      WIN      " );
+        }
+        player->screen.set_bg_color( 196 );
+        player->screen.set_fg_color( 255 );
+        player->screen.print( top_row + 15, start_col + 23, "               " );
+        player->screen.print( top_row + 16, start_col + 23, "  QUIT? (y/n)  " );
+        player->screen.print( top_row + 17, start_col + 23, "               " );
+        player->screen.set_bright( false );
     }
 
-    if ( help_screen )
+    if ( player->help_screen )
     {
-        static std::array< const char*, 10 > help_screen_text = {
+        static std::array< const char*, 15 > help_screen_text = {
             "                                           ",
             "        Freecell for Terminal Help         ",
             "                                           ",
             "  [F1]: Toggle help screen                 ",
             "  [arrow keys]: move cursor                ",
-            "  [space]: select/deselect/move card       ",
+            "  [space]: select/move cards, again on the ",
+            "     selection to select one card less     ",
             "  [enter]: move card to foundation         ",
             "  [u]: undo last move                      ",
+            "  [r]: redo undone move                    ",
+            "  [h]: show/hide hints                     ",
             "  [q]: quit                                ",
+            "  [mouse]: click or drag cards to move,    ",
+            "     right click to move to foundation     ",
             "                                           ",
         };
 
-        std::cout << csi::set_bg_color( 235 ) << csi::set_fg_color( 255 );
+        player->screen.set_bg_color( 235 );
+        player->screen.set_fg_color( 255 );
         for ( size_t i = 0; i < help_screen_text.size(); ++i )
         {
-            std::cout << csi::reset_cursor( top_row + 8 + i, start_col + 9 ) << help_screen_text[ i ];
+            player->screen.print( top_row + 8 + i, start_col + 9, help_screen_text[ i ] );
         }
     }
 
-    std::cout << csi::set_bg_color( 16 ) << csi::set_fg_color( 231 )
-              << csi::reset_cursor( top_row + 42, frame_start_col ) << "[F1]: help"
-              << csi::reset_cursor( top_row + 42, frame_start_col + 53 ) << "Seed = " << game_seed;
+    player->screen.set_bg_color( 16 );
+    player->screen.set_fg_color( 231 );
+    player->screen.print( top_row + 42, frame_start_col, "[F1]: help" );
+    // Without a hint worker, only the solution database gives hints
+    const HintWorker::Hint hint = current_hint();
+    if ( player->show_hints && ( hints || hint.status != HintWorker::Status::Thinking ) )
+    {
+        std::string text;
+        switch ( hint.status )
+        {
+        case HintWorker::Status::Thinking: text = "Thinking..."; break;
+        case HintWorker::Status::Solvable: text = "Solvable, try " + to_str( hint.move ); break;
+        case HintWorker::Status::DeadEnd:  text = "Dead end"; break;
+        case HintWorker::Status::Unknown:  text = "Hard to tell"; break;
+        }
+        player->screen.print( top_row + 42, frame_start_col + ( frame_width - static_cast< int >( text.size() ) ) / 2, text );
+    }
+
+    std::string name = game_name();
+    player->screen.print( top_row + 42, frame_start_col + frame_width - static_cast< int >( name.size() ), name );
+
+    player->screen.flush( player->term_out );
+}
+
+void draw_frame()
+{
+    TRACE_TIMESTAMP( frame_start );
 
-    std::cout << std::flush;
+    render_frame();
+    player->term_out.flush( STDOUT_FILENO );
+
+    TRACE( Debug, Frame, trace_now() - frame_start, player->term_out.stats().last_frame_bytes );
 }
 
 const char usage[] = R"(
-usage: freecell [--seed 7-digit-num]
+usage: freecell [--seed 7-digit-num | --deal N] [--solve [--threads N]] [--log FILE] [--fps N]
+                [--trace FILE] [--solution-db FILE] [--save FILE | --no-save]
+       freecell --replay FILE [--watch]
+       freecell --serve SOCKET [--solution-db FILE] [--fps N]
+       freecell --connect SOCKET [--seed 7-digit-num | --deal N]
+       freecell --analyze-range FROM TO [--ms-deals] [--moves] [--threads N] [--output FILE]
+
+  --deal           play Microsoft FreeCell deal N (1 to 8589934591)
+  --solve          print a solution for the deal instead of playing, exits
+                   with status 2 if none was found
+  --log            record the game to FILE
+  --trace          with a build with tracing, write traces to FILE on exit and
+                   on SIGUSR1
+  --fps            draw at most N frames per second (default 60), keys
+                   arriving faster are applied together
+  --solution-db    take hints for deals in FILE from it, see freecell_db
+  --save           keep the game in FILE (default ~/.freecell_save) when
+                   quitting or disconnected, and resume it next time unless
+                   a deal or --log is given
+  --no-save        neither resume nor save
+  --replay         check that the game recorded in FILE is valid, printing
+                   its result, exits with status 2 if it is not
+  --watch          show the recorded game move by move instead, [q] quits
+                   and any other key skips ahead
+  --serve          host games for clients connecting to the Unix domain
+                   socket SOCKET, until SIGINT, SIGTERM or SIGHUP
+  --connect        play a game hosted by freecell --serve on SOCKET
+  --analyze-range  solve every seed from FROM to TO (inclusive), printing
+                   "seed result moves expanded microseconds" per seed
+  --ms-deals       analyze Microsoft deal numbers instead of seeds
+  --moves          also print the solution of each solved seed, as input for
+                   freecell_db
+  --threads        number of worker threads for --analyze-range (all cores by
+                   default) or --solve (one by default)
+  --output         write analysis to FILE, resuming from FILE.checkpoint if an
+                   earlier run was interrupted
 )";
 
 enum class Key
@@ -645,6 +1207,8 @@ enum class Key
     Unknown,
     Q,
     U,
+    R,
+    H,
     Y,
     N,
     Space,
@@ -656,64 +1220,59 @@ enum class Key
     F1,
 };
 
-Key extract_key( std::string_view &input )
+// Pasted text counts as typed, so that a sequence of keys can be pasted
+Key to_key( const InputEvent &ev )
 {
-    switch ( input[ 0 ] )
-    {
-    case 'q': case 'Q': input = input.substr( 1 ); return Key::Q;
-    case 'u': case 'U': input = input.substr( 1 ); return Key::U;
-    case 'y': case 'Y': input = input.substr( 1 ); return Key::Y;
-    case 'n': case 'N': input = input.substr( 1 ); return Key::N;
-    case ' ':           input = input.substr( 1 ); return Key::Space;
-    case '\r':          input = input.substr( 1 ); return Key::Enter;
-    case '\033':
-        if ( input.size() >= 3 && input.substr( 0, 3 ) == "\033[A"   ) { input = input.substr( 3 ); return Key::ArrowUp; }
-        if ( input.size() >= 3 && input.substr( 0, 3 ) == "\033[B"   ) { input = input.substr( 3 ); return Key::ArrowDown; }
-        if ( input.size() >= 3 && input.substr( 0, 3 ) == "\033[C"   ) { input = input.substr( 3 ); return Key::ArrowRight; }
-        if ( input.size() >= 3 && input.substr( 0, 3 ) == "\033[D"   ) { input = input.substr( 3 ); return Key::ArrowLeft; }
-        if ( input.size() >= 5 && input.substr( 0, 5 ) == "\033[11~" ) { input = input.substr( 5 ); return Key::F1; }
-        if ( input.size() >= 3 && input.substr( 0, 3 ) == "\033OP"   ) { input = input.substr( 3 ); return Key::F1; }
-    }
-
-    // Unknown char sequence
-    std::cerr << "Unhandled data of size = " << input.size() << "\n";
-    std::cerr << "Bytes:\n";
-    for ( char c : input )
+    switch ( ev.key )
     {
-        int val = static_cast< unsigned int >( static_cast< unsigned char >( c ) );
-        std::cerr << "  - " << val;
-        if ( isprint( val ) )
+    case InputKey::Char:
+        if ( ev.modifiers & ( InputModifier::Ctrl | InputModifier::Alt ) )
+        {
+            return Key::Unknown;
+        }
+        switch ( ev.ch )
         {
-            std::cerr << "[" << (char)val << "]";
+        case 'q': case 'Q': return Key::Q;
+        case 'u': case 'U': return Key::U;
+        case 'r': case 'R': return Key::R;
+        case 'h': case 'H': return Key::H;
+        case 'y': case 'Y': return Key::Y;
+        case 'n': case 'N': return Key::N;
+        case ' ':           return Key::Space;
         }
-        std::cerr << "\n";
+        return Key::Unknown;
+    case InputKey::Enter: return Key::Enter;
+    case InputKey::Left:  return Key::ArrowLeft;
+    case InputKey::Right: return Key::ArrowRight;
+    case InputKey::Up:    return Key::ArrowUp;
+    case InputKey::Down:  return Key::ArrowDown;
+    case InputKey::F1:    return Key::F1;
+    default:              return Key::Unknown;
     }
-    input = std::string_view();
-    return Key::Unknown;
 }
 
 void process_key( Key k )
 {
-    if ( quit_confirmation )
+    if ( player->quit_confirmation )
     {
         switch ( k )
         {
         case Key::Y:
-            running = false;
+            player->running = false;
             return;
         case Key::N:
-            quit_confirmation = false;
+            player->quit_confirmation = false;
             return;
         default:
             return;
         }
     }
 
-    if ( help_screen )
+    if ( player->help_screen )
     {
         if ( k == Key::F1 )
         {
-            help_screen = false;
+            player->help_screen = false;
         }
         return;
     }
@@ -721,38 +1280,54 @@ void process_key( Key k )
     switch ( k )
     {
     case Key::U:
-    {
-        GameState *prev_state = get_previous_state();
-        if ( prev_state )
+        if ( player->history.undo( player->game ) )
         {
-            game->in_history = false;
-            game = prev_state;
-            selected_row = -1;
-            selected_col = -1;
+            TRACE( Info, Undo, 0, player->history.position() );
+            game_log.write_undo();
+            game_changed();
+            player->selected_row = -1;
+            player->selected_col = -1;
         }
         return;
-    }
+    case Key::R:
+        if ( player->history.redo( player->game ) )
+        {
+            TRACE( Info, Redo, 0, player->history.position() );
+            game_log.write_redo();
+            game_changed();
+            player->selected_row = -1;
+            player->selected_col = -1;
+        }
+        return;
+    case Key::H:
+        player->show_hints = ! player->show_hints;
+        return;
     case Key::Q:
-        quit_confirmation = true;
+        player->quit_confirmation = true;
         return;
     case Key::F1:
-        help_screen = true;
+        player->help_screen = true;
         return;
     case Key::Space:
-        if ( selected_row == -1 )
+        if ( player->selected_row == -1 )
         {
-            // Select non empty cells/cascades
-            if ( ( cursor_row == 0 && game->cells[ cursor_col ] ) || ( cursor_row == 1 && game->cascades[ cursor_col ].size ) )
+            // Select non empty cells/cascades, with as many cards of the
+            // cascade as could be moved together
+            if ( ( player->cursor_row == 0 && player->game.cells[ player->cursor_col ] ) || ( player->cursor_row == 1 && player->game.cascades[ player->cursor_col ].size ) )
             {
-                selected_row = cursor_row;
-                selected_col = cursor_col;
+                player->selected_row = player->cursor_row;
+                player->selected_col = player->cursor_col;
+                player->selected_count = ( player->cursor_row == 1 ? movable_run( player->game.cascades[ player->cursor_col ] ) : 1 );
             }
         }
-        else if ( selected_row == cursor_row && selected_col == cursor_col )
+        else if ( player->selected_row == player->cursor_row && player->selected_col == player->cursor_col )
         {
-            // Deselect
-            selected_row = -1;
-            selected_col = -1;
+            // Select one card less, deselect after the last one
+            if ( --player->selected_count == 0 )
+            {
+                player->selected_row = -1;
+                player->selected_col = -1;
+            }
         }
         else
         {
@@ -764,31 +1339,31 @@ void process_key( Key k )
         try_move_to_foundation();
         return;
     case Key::ArrowUp:
-        if ( cursor_row > 0 )
+        if ( player->cursor_row > 0 )
         {
-            --cursor_row;
-            if ( cursor_col > 3 )
+            --player->cursor_row;
+            if ( player->cursor_col > 3 )
             {
-                cursor_col = 3;
+                player->cursor_col = 3;
             }
         }
         return;
     case Key::ArrowDown:
-        if ( cursor_row < 1 )
+        if ( player->cursor_row < 1 )
         {
-            ++cursor_row;
+            ++player->cursor_row;
         }
         return;
     case Key::ArrowLeft:
-        if ( cursor_col > 0 )
+        if ( player->cursor_col > 0 )
         {
-            --cursor_col;
+            --player->cursor_col;
         }
         return;
     case Key::ArrowRight:
-        if ( ( cursor_row == 0 && cursor_col < 3 ) || ( cursor_row == 1 && cursor_col < 7 ) )
+        if ( ( player->cursor_row == 0 && player->cursor_col < 3 ) || ( player->cursor_row == 1 && player->cursor_col < 7 ) )
         {
-            ++cursor_col;
+            ++player->cursor_col;
         }
         return;
     default:
@@ -796,125 +1371,1602 @@ void process_key( Key k )
     }
 }
 
-int main( int argc, char* argv[] )
+bool is_selected( const Hit &h )
 {
-    for ( int i = 1; i < argc; )
+    return h.loc != Location::Foundation && player->selected_row == ( h.loc == Location::Cell ? 0 : 1 ) && player->selected_col == h.idx;
+}
+
+// Cards selected by clicking a card of a cascade: from that card down, or the
+// whole run if the card is not part of it
+int clicked_count( const Hit &h )
+{
+    const Cascade &cascade = player->game.cascades[ h.idx ];
+    const int run = movable_run( cascade );
+    return ( h.card >= 0 && cascade.size - h.card <= run ? cascade.size - h.card : run );
+}
+
+bool select_hit( const Hit &h )
+{
+    if ( h.loc == Location::Foundation || ( h.loc == Location::Cell ? ! player->game.cells[ h.idx ] : player->game.cascades[ h.idx ].size == 0 ) )
     {
-        using namespace std::literals;
-        if ( argv[ i ] == "--help"sv )
+        return false;
+    }
+
+    player->selected_row = ( h.loc == Location::Cell ? 0 : 1 );
+    player->selected_col = h.idx;
+    player->selected_count = ( h.loc == Location::Cascade ? clicked_count( h ) : 1 );
+    return true;
+}
+
+// A click moves the selected cards to what is clicked if possible, otherwise
+// selects it. Clicking the selection again deselects it, or changes how many
+// cards are selected if another card of the cascade is clicked.
+void click( const Hit &h )
+{
+    if ( h.loc != Location::Foundation )
+    {
+        player->cursor_row = ( h.loc == Location::Cell ? 0 : 1 );
+        player->cursor_col = h.idx;
+    }
+
+    if ( is_selected( h ) )
+    {
+        const int count = ( h.loc == Location::Cascade ? clicked_count( h ) : 1 );
+        if ( count == player->selected_count )
         {
-            std::cerr << usage + 1;
-            return 0;
+            player->selected_row = -1;
+            player->selected_col = -1;
         }
-
-        if ( argv[ i ] == "--seed"sv )
+        else
         {
-            if ( i + 1 >= argc )
-            {
-                std::cerr << "--seed requires a value\n";
-                return 1;
-            }
+            player->selected_count = count;
+        }
+        return;
+    }
 
-            std::string_view n = argv[ i + 1 ];
-            if ( n.size() != 7 || ! std::all_of( n.begin(), n.end(), ::isdigit ) || n[ 0 ] == '0' )
-            {
-                std::cerr << "Invalid value: " << n << "\n";
-                return 1;
-            }
+    if ( player->selected_row != -1 && try_move_to( h.loc, h.idx ) )
+    {
+        return;
+    }
 
-            game_seed = std::stoull( argv[ i + 1 ] );
+    select_hit( h );
+}
 
-            i += 2;
-            continue;
-        }
+// Acts on the release of a button rather than the press, so that a click, or
+// a drag of cards to where they go, is a single change and a single frame.
+// Returns whether anything changed.
+bool process_mouse( const InputEvent &ev )
+{
+    if ( player->quit_confirmation || player->help_screen )
+    {
+        return false;
+    }
 
-        std::cerr << "Unknown argument: " << argv[ i ] << "\n";
-        return 1;
+    const Hit h = player->hit_map.hit( player->game, ev.row, ev.col );
+    if ( ev.action == MouseAction::Press )
+    {
+        player->mouse_press = h;
+        player->mouse_button = ev.button;
+        return false;
+    }
+    if ( ev.action != MouseAction::Release || player->mouse_press.idx < 0 )
+    {
+        return false;
     }
 
-    if ( game_seed == 0 )
+    const Hit from = player->mouse_press;
+    player->mouse_press = Hit();
+
+    const bool same_place = ( h.loc == from.loc && h.idx == from.idx );
+    if ( player->mouse_button == 2 )
     {
-        std::random_device rd;
-        do {
-            game_seed = rd();
-        } while ( game_seed < 1000000 || game_seed > 9999999 );
+        // Right click sends the card to its foundation, like [enter]
+        if ( ! same_place || from.loc == Location::Foundation )
+        {
+            return false;
+        }
+        player->cursor_row = ( from.loc == Location::Cell ? 0 : 1 );
+        player->cursor_col = from.idx;
+        try_move_to_foundation();
+        return true;
+    }
+    if ( player->mouse_button != 0 )
+    {
+        return false;
+    }
+
+    if ( same_place )
+    {
+        click( from );
+        return true;
     }
 
-    ioctl(STDIN_FILENO, TIOCGWINSZ, &term_size);
+    // Dragged. If the cards cannot go there they are left selected.
+    if ( h.idx < 0 || ! select_hit( from ) )
+    {
+        return false;
+    }
+    if ( try_move_to( h.loc, h.idx ) && h.loc != Location::Foundation )
+    {
+        player->cursor_row = ( h.loc == Location::Cell ? 0 : 1 );
+        player->cursor_col = h.idx;
+    }
+    return true;
+}
 
-    // Keep around for cleanup
-    struct termios old_attr;
-    tcgetattr( STDIN_FILENO, &old_attr );
+// Returns whether the event changed anything on screen
+bool process_input( const InputEvent &ev )
+{
+    TRACE( Debug, Input, static_cast< int >( ev.key ) | ev.modifiers << 8 | static_cast< int >( ev.action ) << 16,
+           ev.key == InputKey::Mouse ? ev.row << 16 | ev.col : ev.ch );
 
+    if ( ev.key == InputKey::Mouse )
     {
-        struct termios new_attr = old_attr;
-        cfmakeraw( &new_attr );
-        new_attr.c_cc[ VMIN ] = 1; // Return after 1 char
-        new_attr.c_cc[ VTIME ] = 0; // Don't wait
-        tcsetattr( STDIN_FILENO, TCSANOW, &new_attr );
+        return process_mouse( ev );
     }
 
-    std::cout << csi::set_alternate_screen() << csi::hide_cursor();
+    process_key( to_key( ev ) );
+    return true;
+}
+
+// Standard notation, cascades are 1-8, cells a-d and foundations h
+int print_solution()
+{
+    GameState st;
+    deal_game( st );
+
+    auto start_time = std::chrono::steady_clock::now();
+    SolverOptions opts;
+    opts.threads = solve_threads;
+    SolveResult res = solve( st, opts );
+    std::chrono::duration< double, std::milli > elapsed = std::chrono::steady_clock::now() - start_time;
 
-    std::cerr << "Term width = " << term_size.ws_col << "\n";
-    std::cerr << "Term height = " << term_size.ws_row << "\n";
+    std::cout << game_name() << "\n";
 
+    switch ( res.status )
     {
-        std::array< Card, 52 > deck;
-        for ( uint8_t suit = 1; suit <= 4; ++suit )
-        {
-            for ( uint8_t number = 1; number <= 13; ++number )
-            {
-                Card &card = deck[ ( suit - 1 ) * 13 + ( number - 1 ) ];
-                card.m_suit = static_cast< Suit >( suit );
-                card.m_number = static_cast< Number >( number );
-            }
-        }
+    case SolveStatus::Solved:
+        std::cout << "Solved in " << res.moves.size() << " moves";
+        break;
+    case SolveStatus::Unsolvable:
+        std::cout << "No solution";
+        break;
+    case SolveStatus::LimitReached:
+        std::cout << "Gave up";
+        break;
+    }
+    std::cout << " (" << res.expanded << " positions expanded, " << elapsed.count() << " ms";
+    if ( solve_threads > 1 )
+    {
+        std::cout << ", " << solve_threads << " threads";
+    }
+    std::cout << ")\n";
 
-        std::shuffle( deck.begin(), deck.end(), std::mt19937_64( game_seed ) );
+    for ( size_t i = 0; i < res.moves.size(); ++i )
+    {
+        const Move &m = res.moves[ i ];
+        const Card c = card_from_code( m.from == Location::Cell
+                                       ? st.cells[ m.from_idx ]
+                                       : st.cascades[ m.from_idx ].m_cards[ st.cascades[ m.from_idx ].size - m.count ] );
 
-        Cascade *cur_cascade = &game->cascades[ 0 ];
-        for ( const Card &c : deck )
+        std::cout << std::setw( 3 ) << i + 1 << ". " << to_str( m ) << " " << to_str( c.m_number ) << to_str( c.m_suit );
+        if ( m.count > 1 )
         {
-            cur_cascade->m_cards[ cur_cascade->size++ ] = c;
-            ++cur_cascade;
-            if ( cur_cascade == game->cascades.end() )
-            {
-               cur_cascade = &game->cascades[ 0 ];
-            }
+            std::cout << " (" << static_cast< int >( m.count ) << " cards)";
         }
-        game->in_history = true;
+        std::cout << "\n";
+
+        apply_move( st, m );
     }
 
-    signal( SIGWINCH, []( int )
+    return res.status == SolveStatus::Solved ? 0 : 2;
+}
+
+int replay_game( const std::string &path )
+{
+    GameLog log;
+    if ( ! read_game_log( path, log ) )
     {
-        ioctl(STDIN_FILENO, TIOCGWINSZ, &term_size);
-        draw_frame();
-    });
+        std::cerr << "Cannot read game log " << path << "\n";
+        return 1;
+    }
 
-    while ( running )
+    GameState st;
+    History hist;
+    start_game( log, st, hist );
+
+    auto start_time = std::chrono::steady_clock::now();
+    size_t applied = 0;
+    while ( applied < log.records.size() && apply_record( log.records[ applied ], st, hist ) )
     {
-        draw_frame();
+        ++applied;
+    }
+    std::chrono::duration< double, std::milli > elapsed = std::chrono::steady_clock::now() - start_time;
 
-        char input_buf[ 100 ];
-        int s = read( STDIN_FILENO, input_buf, 100 );
+    player->game_seed = log.seed;
+    player->ms_deal = log.ms_deal;
+    std::cout << game_name() << "\n";
 
-        std::string_view input( input_buf, s );
+    if ( applied < log.records.size() )
+    {
+        std::cout << "Invalid action " << applied + 1 << " of " << log.records.size() << "\n";
+        return 2;
+    }
 
-        while ( input.size() )
-        {
-            std::cerr << "Processing input of size = " << input.size() << "\n";
-            process_key( extract_key( input ) );
-        }
-        if( is_full_foundations( game ) )
-	        process_key( Key::Q );
+    std::cout << log.records.size() << " actions, " << hist.position() << " moves, "
+              << ( is_full_foundations( st ) ? "won" : "not won" )
+              << " (" << elapsed.count() << " ms)\n";
+    return 0;
+}
+
+using Clock = std::chrono::steady_clock;
+
+int signal_fd = -1; // signalfd for SIGWINCH, SIGINT, SIGTERM and SIGHUP, and SIGUSR1 with tracing
+std::string trace_path; // Where to dump traces, if anywhere
+Clock::duration min_frame_interval = std::chrono::milliseconds( 1000 / 60 );
+
+std::vector< InputEvent > input_events; // Reused, to not allocate per read
+
+// How long to wait for the rest of an escape sequence before taking what came
+// as is, a lone escape being the Escape key
+const auto escape_timeout = std::chrono::milliseconds( 50 );
+
+// Resizes are delivered through a file descriptor rather than a handler, so
+// that they are handled in the event loop like any other event. So are
+// requests to dump traces, which can then be written out safely, and to
+// terminate, so that the game is saved first.
+bool setup_signal_fd()
+{
+    sigset_t mask;
+    sigemptyset( &mask );
+    sigaddset( &mask, SIGWINCH );
+    sigaddset( &mask, SIGINT );
+    sigaddset( &mask, SIGTERM );
+    sigaddset( &mask, SIGHUP );
+#ifdef FREECELL_TRACE
+    sigaddset( &mask, SIGUSR1 );
+#endif
+    if ( sigprocmask( SIG_BLOCK, &mask, nullptr ) != 0 )
+    {
+        return false;
     }
 
+    signal_fd = signalfd( -1, &mask, SFD_NONBLOCK | SFD_CLOEXEC );
+    return signal_fd >= 0;
+}
+
+bool is_stop_signal( uint32_t signo )
+{
+    return signo == SIGINT || signo == SIGTERM || signo == SIGHUP;
+}
+
+bool input_pending()
+{
+    struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+    return poll( &pfd, 1, 0 ) > 0;
+}
+
+// Waits up to timeout_ms (-1 for no limit) for input, a resize or a new hint.
+// Resizes and hints are handled here, setting redraw. Returns true if there
+// is input to read.
+bool wait_for_events( int timeout_ms, bool &redraw )
+{
+    struct pollfd fds[ 3 ] = {
+        { STDIN_FILENO, POLLIN, 0 },
+        { signal_fd, POLLIN, 0 },
+        { hints ? hints->notify_fd() : -1, POLLIN, 0 }, // Ignored by poll when negative
+    };
+
+    if ( poll( fds, 3, timeout_ms ) <= 0 )
+    {
+        return false;
+    }
+
+    if ( fds[ 1 ].revents & POLLIN )
+    {
+        // Only the latest size matters, however many resizes there were
+        bool resized = false;
+        struct signalfd_siginfo info;
+        while ( read( signal_fd, &info, sizeof( info ) ) > 0 )
+        {
+            if ( is_stop_signal( info.ssi_signo ) )
+            {
+                player->running = false;
+                continue;
+            }
+#ifdef FREECELL_TRACE
+            if ( info.ssi_signo == SIGUSR1 )
+            {
+                if ( ! trace_path.empty() )
+                {
+                    trace_buffer.dump( trace_path );
+                }
+                continue;
+            }
+#endif
+            resized = true;
+        }
+
+        if ( resized )
+        {
+            ioctl( STDIN_FILENO, TIOCGWINSZ, &player->term_size );
+            TRACE( Info, Resize, player->term_size.ws_row, player->term_size.ws_col );
+            redraw = true;
+        }
+    }
+
+    if ( fds[ 2 ].revents & POLLIN )
+    {
+        char buf[ 64 ];
+        while ( read( hints->notify_fd(), buf, sizeof( buf ) ) > 0 )
+        {
+        }
+        redraw = true;
+    }
+
+    return fds[ 0 ].revents & ( POLLIN | POLLHUP );
+}
+
+int millis_until( Clock::time_point t )
+{
+    auto now = Clock::now();
+    if ( t <= now )
+    {
+        return 0;
+    }
+    // Rounded up, so that waking up early does not cause a busy loop
+    return std::chrono::duration_cast< std::chrono::milliseconds >( t - now + std::chrono::microseconds( 999 ) ).count();
+}
+
+// Reads whatever input is available and decodes it into input_events.
+// Returns false when the terminal is gone.
+bool read_input()
+{
+    input_events.clear();
+    do
+    {
+        char input_buf[ 4096 ];
+        ssize_t s = read( STDIN_FILENO, input_buf, sizeof( input_buf ) );
+        if ( s == 0 )
+        {
+            return false;
+        }
+        if ( s < 0 )
+        {
+            break;
+        }
+        player->input_decoder.feed( input_buf, s, input_events );
+    } while ( input_pending() );
+    return true;
+}
+
+// Terminal attributes to restore on leaving
+struct termios saved_term_attr;
+
+// Switches the terminal to raw input and an alternate screen for the game
+void enter_terminal()
+{
+    ioctl( STDIN_FILENO, TIOCGWINSZ, &player->term_size );
+    tcgetattr( STDIN_FILENO, &saved_term_attr );
+
+    struct termios new_attr = saved_term_attr;
+    cfmakeraw( &new_attr );
+    new_attr.c_cc[ VMIN ] = 1; // Return after 1 char
+    new_attr.c_cc[ VTIME ] = 0; // Don't wait
+    tcsetattr( STDIN_FILENO, TCSANOW, &new_attr );
+
+    player->term_out << csi::set_alternate_screen() << csi::hide_cursor() << csi::enable_bracketed_paste();
+}
+
+void leave_terminal()
+{
+    player->term_out << csi::disable_mouse() << csi::disable_bracketed_paste() << csi::show_cursor() << csi::reset_alternate_screen();
+    player->term_out.flush( STDOUT_FILENO );
+    tcsetattr( STDIN_FILENO, TCSANOW, &saved_term_attr );
+}
+
+// Applies every key available, then draws a single frame for all of them, and
+// no sooner than min_frame_interval after the last one. Key repeats over a
+// slow link are so handled in batches instead of queueing a frame each.
+void run_game()
+{
+    Clock::time_point last_frame;
+    Clock::time_point last_input;
+    bool redraw = true;
+
+    while ( player->running )
+    {
+        int timeout_ms = -1;
+        if ( redraw )
+        {
+            Clock::time_point next_frame = last_frame + min_frame_interval;
+            if ( Clock::now() >= next_frame )
+            {
+                draw_frame();
+                last_frame = Clock::now();
+                redraw = false;
+            }
+            else
+            {
+                timeout_ms = millis_until( next_frame );
+            }
+        }
+
+        if ( player->input_decoder.pending() )
+        {
+            int escape_ms = millis_until( last_input + escape_timeout );
+            timeout_ms = ( timeout_ms < 0 ? escape_ms : std::min( timeout_ms, escape_ms ) );
+        }
+
+        if ( wait_for_events( timeout_ms, redraw ) )
+        {
+            if ( ! read_input() )
+            {
+                player->running = false; // Terminal is gone
+                break;
+            }
+            last_input = Clock::now();
+        }
+        else if ( player->input_decoder.pending() && Clock::now() >= last_input + escape_timeout )
+        {
+            input_events.clear();
+            player->input_decoder.flush( input_events );
+        }
+        else
+        {
+            continue;
+        }
+
+        for ( const InputEvent &ev : input_events )
+        {
+            redraw |= process_input( ev );
+            if ( ! player->running )
+            {
+                break;
+            }
+        }
+
+        if ( is_full_foundations( player->game ) && ! player->quit_confirmation )
+        {
+            process_key( Key::Q );
+        }
+    }
+}
+
+// Keeps the game for the next run, unless it is over
+void save_progress()
+{
+    if ( save_path.empty() )
+    {
+        return;
+    }
+
+    if ( is_full_foundations( player->game ) )
+    {
+        unlink( save_path.c_str() );
+    }
+    else if ( ! save_game( save_path, player->game_seed, player->ms_deal, player->game, player->history ) )
+    {
+        std::cerr << "Cannot save game to " << save_path << "\n";
+    }
+}
+
+// Plays back a recorded game in the terminal, a move every replay_delay
+void watch_replay( const GameLog &log )
+{
+    const auto replay_delay = std::chrono::milliseconds( 300 );
+
+    size_t next = 0;
+    Clock::time_point next_step = Clock::now() + replay_delay;
+    bool redraw = true;
+
+    while ( player->running )
+    {
+        if ( redraw )
+        {
+            draw_frame();
+            redraw = false;
+        }
+
+        const bool at_end = ( next == log.records.size() );
+        if ( wait_for_events( at_end ? -1 : millis_until( next_step ), redraw ) )
+        {
+            if ( ! read_input() )
+            {
+                player->running = false;
+                continue;
+            }
+
+            // Escape sequences are not waited for here, any key will do
+            player->input_decoder.flush( input_events );
+            for ( const InputEvent &ev : input_events )
+            {
+                if ( to_key( ev ) == Key::Q || at_end )
+                {
+                    player->running = false;
+                }
+                next_step = Clock::now(); // Skip ahead
+            }
+        }
+
+        if ( ! at_end && Clock::now() >= next_step )
+        {
+            if ( ! apply_record( log.records[ next++ ], player->game, player->history ) )
+            {
+                // Stay at the last valid position
+                next = log.records.size();
+            }
+            next_step = Clock::now() + replay_delay;
+            redraw = true;
+        }
+    }
+}
+
+// A client of the game server
+struct Session
+{
+    explicit Session( int fd ) : fd( fd ) {}
+
+    int fd;
+    size_t index = 0; // In GameServer::m_open
+    bool started = false; // Whether Start was received
+    bool redraw = false;
+    bool writing = false; // Whether waiting for the socket to take the rest of a frame
+    bool waiting = false; // Whether in GameServer::m_waiting
+    PlayerState player; // Output not yet sent is in player.term_out
+    std::string in; // Received, up to the end of the last complete message
+    Clock::time_point last_frame;
+    Clock::time_point last_input;
+};
+
+// Hosts games for clients connecting to a Unix domain socket, see
+// protocol.h. A single thread serves every session from an epoll loop, so
+// one server per core is the way to use more of them.
+//
+// Sessions get the same treatment as a local game does in run_game(): input
+// is applied as it arrives, frames are drawn at most every
+// min_frame_interval, and escape sequences cut short by escape_timeout. A
+// frame is not drawn until the last one is sent, so a slow client gets fewer
+// frames rather than a backlog of them.
+class GameServer
+{
+public:
+    GameServer() = default;
+    GameServer( const GameServer& ) = delete;
+    GameServer& operator=( const GameServer& ) = delete;
+    ~GameServer();
+
+    // Returns false on error, printing it
+    bool listen( const std::string &path );
+
+    // Until SIGINT, SIGTERM or SIGHUP
+    void run();
+
+    void print_stats() const;
+
+private:
+    template < typename F >
+    void with_player( Session &s, F f )
+    {
+        PlayerState *prev = player;
+        player = &s.player;
+        f();
+        player = prev;
+    }
+
+    // These return false when the session is to be closed
+    bool receive( Session &s );
+    bool handle_message( Session &s, ClientMessage type, const char *payload, size_t size );
+    bool begin_game( Session &s, const StartPayload &start );
+    bool set_term_size( Session &s, uint16_t rows, uint16_t cols );
+    bool play( Session &s, const char *input, size_t size );
+    bool draw( Session &s );
+    bool send( Session &s );
+
+    void accept_sessions();
+    void close_session( Session &s );
+    void set_accepting( bool accepting );
+
+    // When the session needs handling without new input, max if never
+    Clock::time_point deadline( const Session &s ) const;
+    void update_waiting( Session &s );
+
+    // Handles the sessions whose deadline passed, returns the next deadline
+    Clock::time_point run_waiting();
+
+    std::string m_path;
+    int m_listen_fd = -1;
+    int m_epoll_fd = -1;
+    bool m_accepting = false; // False while out of file descriptors
+
+    Pool< Session > m_sessions;
+    std::vector< Session* > m_open;
+    std::vector< Session* > m_waiting; // With a deadline
+    std::vector< Session* > m_due; // Reused by run_waiting()
+    std::mt19937_64 m_rng{ std::random_device()() };
+
+    uint64_t m_total_sessions = 0;
+    size_t m_peak_sessions = 0;
+    uint64_t m_frames = 0;
+    uint64_t m_bytes = 0;
+};
+
+GameServer::~GameServer()
+{
+    while ( ! m_open.empty() )
+    {
+        close_session( *m_open.back() );
+    }
+    if ( m_epoll_fd >= 0 )
+    {
+        close( m_epoll_fd );
+    }
+    if ( m_listen_fd >= 0 )
+    {
+        close( m_listen_fd );
+        unlink( m_path.c_str() );
+    }
+}
+
+bool GameServer::listen( const std::string &path )
+{
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if ( path.size() >= sizeof( addr.sun_path ) )
+    {
+        std::cerr << "Socket path is too long: " << path << "\n";
+        return false;
+    }
+    std::copy( path.begin(), path.end(), addr.sun_path );
+
+    // A socket nothing listens on is left behind by a server that did not
+    // exit cleanly, and is replaced
+    auto is_stale = [ & ]
+    {
+        struct stat info;
+        if ( lstat( path.c_str(), &info ) != 0 || ! S_ISSOCK( info.st_mode ) )
+        {
+            return false;
+        }
+        int fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+        bool refused = fd >= 0 && connect( fd, reinterpret_cast< struct sockaddr* >( &addr ), sizeof( addr ) ) != 0 && errno == ECONNREFUSED;
+        close( fd );
+        return refused;
+    };
+
+    m_listen_fd = socket( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+    bool ok = m_listen_fd >= 0 && bind( m_listen_fd, reinterpret_cast< struct sockaddr* >( &addr ), sizeof( addr ) ) == 0;
+    if ( ! ok && errno == EADDRINUSE && is_stale() )
+    {
+        unlink( path.c_str() );
+        ok = bind( m_listen_fd, reinterpret_cast< struct sockaddr* >( &addr ), sizeof( addr ) ) == 0;
+    }
+    if ( ! ok || ::listen( m_listen_fd, SOMAXCONN ) != 0 )
+    {
+        std::cerr << "Cannot listen on " << path << ": " << strerror( errno ) << "\n";
+        return false;
+    }
+    m_path = path;
+
+    m_epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.ptr = &signal_fd;
+    if ( m_epoll_fd < 0 || epoll_ctl( m_epoll_fd, EPOLL_CTL_ADD, signal_fd, &ev ) != 0 )
+    {
+        std::cerr << "Cannot create epoll instance\n";
+        return false;
+    }
+    set_accepting( true );
+
+    // Every session is a file descriptor
+    struct rlimit limit;
+    if ( getrlimit( RLIMIT_NOFILE, &limit ) == 0 && limit.rlim_cur < limit.rlim_max )
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit( RLIMIT_NOFILE, &limit );
+    }
+    return true;
+}
+
+void GameServer::run()
+{
+    std::vector< struct epoll_event > events( 256 );
+    bool stopping = false;
+    while ( ! stopping )
+    {
+        const Clock::time_point next = run_waiting();
+        const int timeout_ms = ( next == Clock::time_point::max() ? -1 : millis_until( next ) );
+
+        const int n = epoll_wait( m_epoll_fd, events.data(), events.size(), timeout_ms );
+        for ( int i = 0; i < n; ++i )
+        {
+            const struct epoll_event &ev = events[ i ];
+            if ( ev.data.ptr == &m_listen_fd )
+            {
+                accept_sessions();
+            }
+            else if ( ev.data.ptr == &signal_fd )
+            {
+                struct signalfd_siginfo info;
+                while ( read( signal_fd, &info, sizeof( info ) ) > 0 )
+                {
+                    stopping |= is_stop_signal( info.ssi_signo );
+#ifdef FREECELL_TRACE
+                    if ( info.ssi_signo == SIGUSR1 && ! trace_path.empty() )
+                    {
+                        trace_buffer.dump( trace_path );
+                    }
+#endif
+                }
+            }
+            else
+            {
+                Session &s = *static_cast< Session* >( ev.data.ptr );
+                bool ok = true;
+                if ( ev.events & EPOLLOUT )
+                {
+                    // Frames held back for the last one are drawn once it is sent
+                    ok = send( s ) && draw( s );
+                }
+                if ( ok && ( ev.events & ( EPOLLIN | EPOLLHUP | EPOLLERR ) ) )
+                {
+                    ok = receive( s );
+                }
+                if ( ! ok )
+                {
+                    close_session( s );
+                }
+            }
+        }
+    }
+}
+
+void GameServer::print_stats() const
+{
+    std::cerr << "Sessions = " << m_total_sessions
+              << ", peak = " << m_peak_sessions
+              << ", frames = " << m_frames
+              << ", bytes = " << m_bytes << "\n";
+}
+
+bool GameServer::receive( Session &s )
+{
+    char buf[ 4096 ];
+    const ssize_t res = read( s.fd, buf, sizeof( buf ) );
+    if ( res <= 0 )
+    {
+        // Closed by the client, unless there is just nothing to read
+        return res < 0 && ( errno == EAGAIN || errno == EINTR );
+    }
+    s.in.append( buf, res );
+
+    size_t pos = 0;
+    ClientHeader header;
+    while ( s.in.size() - pos >= sizeof( header ) )
+    {
+        memcpy( &header, s.in.data() + pos, sizeof( header ) );
+        if ( header.size > max_payload_size )
+        {
+            return false;
+        }
+        if ( s.in.size() - pos - sizeof( header ) < header.size )
+        {
+            break;
+        }
+        if ( ! handle_message( s, header.type, s.in.data() + pos + sizeof( header ), header.size ) )
+        {
+            return false;
+        }
+        pos += sizeof( header ) + header.size;
+    }
+    s.in.erase( 0, pos );
+
+    return draw( s );
+}
+
+bool GameServer::handle_message( Session &s, ClientMessage type, const char *payload, size_t size )
+{
+    switch ( type )
+    {
+    case ClientMessage::Start:
+    {
+        StartPayload start;
+        if ( s.started || size != sizeof( start ) )
+        {
+            return false;
+        }
+        memcpy( &start, payload, sizeof( start ) );
+        return begin_game( s, start );
+    }
+    case ClientMessage::Input:
+        s.last_input = Clock::now();
+        return s.started && play( s, payload, size );
+    case ClientMessage::Resize:
+    {
+        ResizePayload resize;
+        if ( ! s.started || size != sizeof( resize ) )
+        {
+            return false;
+        }
+        memcpy( &resize, payload, sizeof( resize ) );
+        return set_term_size( s, resize.rows, resize.cols );
+    }
+    }
+    return false;
+}
+
+// The screen takes memory and time to draw in proportion to its size, so a
+// client is not let ask for any size it likes
+bool GameServer::set_term_size( Session &s, uint16_t rows, uint16_t cols )
+{
+    if ( rows == 0 || cols == 0 || rows > max_term_rows || cols > max_term_cols )
+    {
+        return false;
+    }
+
+    s.player.term_size.ws_row = rows;
+    s.player.term_size.ws_col = cols;
+    s.redraw = true;
+    return true;
+}
+
+bool GameServer::begin_game( Session &s, const StartPayload &start )
+{
+    uint64_t seed = start.seed;
+    if ( start.ms_deal ? ( seed < 1 || seed > max_ms_deal ) : ( seed != 0 && ( seed < 1000000 || seed > 9999999 ) ) )
+    {
+        return false;
+    }
+    if ( seed == 0 )
+    {
+        seed = 1000000 + m_rng() % 9000000;
+    }
+
+    if ( ! set_term_size( s, start.rows, start.cols ) )
+    {
+        return false;
+    }
+
+    s.started = true;
+    s.player.game_seed = seed;
+    s.player.ms_deal = start.ms_deal;
+    with_player( s, []
+    {
+        deal_game( player->game );
+        player->history.reset( player->game );
+        auto_play_game();
+        load_known_solution();
+        game_changed();
+    } );
+    s.redraw = true;
+    return true;
+}
+
+// Applies input, or with none given the incomplete escape sequence held
+// back for it. Returns false when the player quits.
+bool GameServer::play( Session &s, const char *input, size_t size )
+{
+    bool redraw = false;
+    with_player( s, [ & ]
+    {
+        input_events.clear();
+        if ( input )
+        {
+            player->input_decoder.feed( input, size, input_events );
+        }
+        else
+        {
+            player->input_decoder.flush( input_events );
+        }
+
+        for ( const InputEvent &ev : input_events )
+        {
+            redraw |= process_input( ev );
+            if ( ! player->running )
+            {
+                break;
+            }
+        }
+
+        if ( is_full_foundations( player->game ) && ! player->quit_confirmation )
+        {
+            process_key( Key::Q );
+        }
+    } );
+
+    s.redraw |= redraw;
+    return s.player.running;
+}
+
+// Draws a frame if one is due and the last one is sent, leaving it for later
+// otherwise
+bool GameServer::draw( Session &s )
+{
+    if ( s.redraw && s.player.term_out.data().empty() && Clock::now() >= s.last_frame + min_frame_interval )
+    {
+        TRACE_TIMESTAMP( frame_start );
+
+        with_player( s, render_frame );
+        s.redraw = false;
+        s.last_frame = Clock::now();
+        ++m_frames;
+
+        TRACE( Debug, Frame, trace_now() - frame_start, s.player.term_out.data().size() );
+
+        if ( ! send( s ) )
+        {
+            return false;
+        }
+    }
+
+    update_waiting( s );
+    return true;
+}
+
+// Sends as much of the frame as the socket takes, and asks to be told when
+// it takes more if that is not all of it
+bool GameServer::send( Session &s )
+{
+    OutputBuffer &out = s.player.term_out;
+    while ( ! out.data().empty() )
+    {
+        const ssize_t res = ::send( s.fd, out.data().data(), out.data().size(), MSG_NOSIGNAL | MSG_DONTWAIT );
+        if ( res < 0 )
+        {
+            if ( errno == EINTR )
+            {
+                continue;
+            }
+            if ( errno != EAGAIN && errno != EWOULDBLOCK )
+            {
+                return false;
+            }
+            break;
+        }
+        m_bytes += res;
+        out.consume( res );
+    }
+
+    const bool writing = ! out.data().empty();
+    if ( writing != s.writing )
+    {
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN | ( writing ? EPOLLOUT : 0 );
+        ev.data.ptr = &s;
+        epoll_ctl( m_epoll_fd, EPOLL_CTL_MOD, s.fd, &ev );
+        s.writing = writing;
+    }
+    return true;
+}
+
+void GameServer::accept_sessions()
+{
+    while ( true )
+    {
+        const int fd = accept4( m_listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC );
+        if ( fd < 0 )
+        {
+            if ( errno == EMFILE || errno == ENFILE )
+            {
+                // Until a session closes, or the listening socket would be
+                // reported ready all along
+                set_accepting( false );
+            }
+            return;
+        }
+
+        Session *s = m_sessions.create( fd );
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.ptr = s;
+        if ( epoll_ctl( m_epoll_fd, EPOLL_CTL_ADD, fd, &ev ) != 0 )
+        {
+            close( fd );
+            m_sessions.destroy( s );
+            continue;
+        }
+
+        s->index = m_open.size();
+        m_open.push_back( s );
+        ++m_total_sessions;
+        m_peak_sessions = std::max( m_peak_sessions, m_open.size() );
+    }
+}
+
+void GameServer::close_session( Session &s )
+{
+    if ( s.waiting )
+    {
+        m_waiting.erase( std::find( m_waiting.begin(), m_waiting.end(), &s ) );
+    }
+
+    m_open.back()->index = s.index;
+    m_open[ s.index ] = m_open.back();
+    m_open.pop_back();
+
+    close( s.fd );
+    m_sessions.destroy( &s );
+
+    if ( ! m_accepting )
+    {
+        set_accepting( true );
+    }
+}
+
+void GameServer::set_accepting( bool accepting )
+{
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.ptr = &m_listen_fd;
+    epoll_ctl( m_epoll_fd, accepting ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, m_listen_fd, &ev );
+    m_accepting = accepting;
+}
+
+Clock::time_point GameServer::deadline( const Session &s ) const
+{
+    Clock::time_point t = Clock::time_point::max();
+    if ( s.redraw && s.player.term_out.data().empty() )
+    {
+        t = s.last_frame + min_frame_interval;
+    }
+    if ( s.player.input_decoder.pending() )
+    {
+        t = std::min( t, s.last_input + escape_timeout );
+    }
+    return t;
+}
+
+void GameServer::update_waiting( Session &s )
+{
+    if ( ! s.waiting && deadline( s ) != Clock::time_point::max() )
+    {
+        m_waiting.push_back( &s );
+        s.waiting = true;
+    }
+}
+
+Clock::time_point GameServer::run_waiting()
+{
+    // Handling a session may put it back
+    m_due.clear();
+    m_due.swap( m_waiting );
+
+    const Clock::time_point now = Clock::now();
+    for ( Session *s : m_due )
+    {
+        s->waiting = false;
+        if ( deadline( *s ) > now )
+        {
+            update_waiting( *s );
+            continue;
+        }
+
+        bool ok = true;
+        if ( s->player.input_decoder.pending() && now >= s->last_input + escape_timeout )
+        {
+            ok = play( *s, nullptr, 0 );
+        }
+        if ( ! ( ok && draw( *s ) ) )
+        {
+            close_session( *s );
+        }
+    }
+
+    Clock::time_point next = Clock::time_point::max();
+    for ( const Session *s : m_waiting )
+    {
+        next = std::min( next, deadline( *s ) );
+    }
+    return next;
+}
+
+int serve_games( const std::string &path )
+{
+    GameServer server;
+    if ( ! server.listen( path ) )
+    {
+        return 1;
+    }
+
+    std::cerr << "Serving games on " << path << "\n";
+    server.run();
+    server.print_stats();
+    return 0;
+}
+
+bool send_all( int fd, std::string_view data )
+{
+    while ( ! data.empty() )
+    {
+        const ssize_t res = send( fd, data.data(), data.size(), MSG_NOSIGNAL );
+        if ( res < 0 )
+        {
+            if ( errno == EINTR )
+            {
+                continue;
+            }
+            return false;
+        }
+        data.remove_prefix( res );
+    }
+    return true;
+}
+
+// Plays a game hosted by a game server, which sends what to show for the
+// input passed on from here
+int play_remote( const std::string &path )
+{
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if ( path.size() >= sizeof( addr.sun_path ) )
+    {
+        std::cerr << "Socket path is too long: " << path << "\n";
+        return 1;
+    }
+    std::copy( path.begin(), path.end(), addr.sun_path );
+
+    const int fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+    if ( fd < 0 || connect( fd, reinterpret_cast< struct sockaddr* >( &addr ), sizeof( addr ) ) != 0 )
+    {
+        std::cerr << "Cannot connect to " << path << "\n";
+        return 1;
+    }
+
+    enter_terminal();
+    player->term_out << csi::enable_mouse();
+    player->term_out.flush( STDOUT_FILENO );
+
+    std::string msg;
+    StartPayload start = {};
+    start.seed = player->game_seed;
+    start.ms_deal = player->ms_deal;
+    // Drawn in the top left corner of a larger terminal than the server takes
+    start.rows = std::min( player->term_size.ws_row, max_term_rows );
+    start.cols = std::min( player->term_size.ws_col, max_term_cols );
+    append_message( msg, ClientMessage::Start, &start, sizeof( start ) );
+    bool connected = send_all( fd, msg );
+
+    while ( connected )
+    {
+        struct pollfd fds[ 3 ] = {
+            { STDIN_FILENO, POLLIN, 0 },
+            { fd, POLLIN, 0 },
+            { signal_fd, POLLIN, 0 },
+        };
+        if ( poll( fds, 3, -1 ) <= 0 )
+        {
+            continue;
+        }
+
+        msg.clear();
+        if ( fds[ 2 ].revents & POLLIN )
+        {
+            bool resized = false;
+            struct signalfd_siginfo info;
+            while ( read( signal_fd, &info, sizeof( info ) ) > 0 )
+            {
+                connected &= ! is_stop_signal( info.ssi_signo );
+                resized |= ( info.ssi_signo == SIGWINCH );
+            }
+
+            if ( resized )
+            {
+                ioctl( STDIN_FILENO, TIOCGWINSZ, &player->term_size );
+                ResizePayload resize = { std::min( player->term_size.ws_row, max_term_rows ), std::min( player->term_size.ws_col, max_term_cols ) };
+                append_message( msg, ClientMessage::Resize, &resize, sizeof( resize ) );
+            }
+        }
+
+        if ( fds[ 0 ].revents & ( POLLIN | POLLHUP ) )
+        {
+            char buf[ max_payload_size ];
+            const ssize_t res = read( STDIN_FILENO, buf, sizeof( buf ) );
+            if ( res > 0 )
+            {
+                append_message( msg, ClientMessage::Input, buf, res );
+            }
+            connected &= ( res > 0 || ( res < 0 && errno == EINTR ) ); // Terminal is gone
+        }
+
+        if ( fds[ 1 ].revents & ( POLLIN | POLLHUP ) )
+        {
+            char buf[ 64 * 1024 ];
+            const ssize_t res = read( fd, buf, sizeof( buf ) );
+            if ( res > 0 )
+            {
+                player->term_out << std::string_view( buf, res );
+                player->term_out.flush( STDOUT_FILENO );
+            }
+            connected &= ( res > 0 || ( res < 0 && errno == EINTR ) ); // Game is over
+        }
+
+        connected = connected && send_all( fd, msg );
+    }
+
+    close( fd );
+    leave_terminal();
+    return 0;
+}
+
+bool parse_uint( std::string_view s, uint64_t &val )
+{
+    if ( s.empty() || s.size() > 19 || ! std::all_of( s.begin(), s.end(), ::isdigit ) )
+    {
+        return false;
+    }
+
+    val = std::stoull( std::string( s ) );
+    return true;
+}
+
+#ifndef FREECELL_NO_MAIN // Built into the benchmark
+int main( int argc, char* argv[] )
+{
+    AnalyzeOptions analyze_opts;
+    std::string log_path;
+    std::string replay_path;
+    std::string serve_path;
+    std::string connect_path;
+    bool watch = false;
+    bool no_save = false;
+    analyze_opts.threads = std::max( 1u, std::thread::hardware_concurrency() );
+
+    for ( int i = 1; i < argc; )
+    {
+        using namespace std::literals;
+        if ( argv[ i ] == "--help"sv )
+        {
+            std::cerr << usage + 1;
+            return 0;
+        }
+
+        if ( argv[ i ] == "--seed"sv )
+        {
+            if ( i + 1 >= argc )
+            {
+                std::cerr << "--seed requires a value\n";
+                return 1;
+            }
+
+            std::string_view n = argv[ i + 1 ];
+            if ( n.size() != 7 || ! std::all_of( n.begin(), n.end(), ::isdigit ) || n[ 0 ] == '0' )
+            {
+                std::cerr << "Invalid value: " << n << "\n";
+                return 1;
+            }
+
+            player->game_seed = std::stoull( argv[ i + 1 ] );
+            player->ms_deal = false;
+
+            i += 2;
+            continue;
+        }
+
+        if ( argv[ i ] == "--deal"sv )
+        {
+            if ( i + 1 >= argc )
+            {
+                std::cerr << "--deal requires a value\n";
+                return 1;
+            }
+
+            uint64_t n;
+            if ( ! parse_uint( argv[ i + 1 ], n ) || n < 1 || n > max_ms_deal )
+            {
+                std::cerr << "Invalid value: " << argv[ i + 1 ] << "\n";
+                return 1;
+            }
+
+            player->game_seed = n;
+            player->ms_deal = true;
+
+            i += 2;
+            continue;
+        }
+
+        if ( argv[ i ] == "--ms-deals"sv )
+        {
+            analyze_opts.ms_deals = true;
+            ++i;
+            continue;
+        }
+
+        if ( argv[ i ] == "--moves"sv )
+        {
+            analyze_opts.moves = true;
+            ++i;
+            continue;
+        }
+
+        if ( argv[ i ] == "--analyze-range"sv )
+        {
+            if ( i + 2 >= argc
+              || ! parse_uint( argv[ i + 1 ], analyze_opts.from )
+              || ! parse_uint( argv[ i + 2 ], analyze_opts.to )
+              || analyze_opts.from > analyze_opts.to )
+            {
+                std::cerr << "--analyze-range requires two values, FROM <= TO\n";
+                return 1;
+            }
+
+            analyze_mode = true;
+            i += 3;
+            continue;
+        }
+
+        if ( argv[ i ] == "--threads"sv )
+        {
+            uint64_t threads = 0;
+            if ( i + 1 >= argc || ! parse_uint( argv[ i + 1 ], threads ) || threads < 1 || threads > 1024 )
+            {
+                std::cerr << "--threads requires a value between 1 and 1024\n";
+                return 1;
+            }
+
+            analyze_opts.threads = threads;
+            solve_threads = threads;
+            i += 2;
+            continue;
+        }
+
+        if ( argv[ i ] == "--output"sv )
+        {
+            if ( i + 1 >= argc )
+            {
+                std::cerr << "--output requires a value\n";
+                return 1;
+            }
+
+            analyze_opts.output = argv[ i + 1 ];
+            i += 2;
+            continue;
+        }
+
+        if ( argv[ i ] == "--log"sv || argv[ i ] == "--replay"sv )
+        {
+            if ( i + 1 >= argc )
+            {
+                std::cerr << argv[ i ] << " requires a value\n";
+                return 1;
+            }
+
+            ( argv[ i ] == "--log"sv ? log_path : replay_path ) = argv[ i + 1 ];
+            i += 2;
+            continue;
+        }
+
+        if ( argv[ i ] == "--serve"sv || argv[ i ] == "--connect"sv )
+        {
+            if ( i + 1 >= argc )
+            {
+                std::cerr << argv[ i ] << " requires a value\n";
+                return 1;
+            }
+
+            ( argv[ i ] == "--serve"sv ? serve_path : connect_path ) = argv[ i + 1 ];
+            i += 2;
+            continue;
+        }
+
+        if ( argv[ i ] == "--save"sv )
+        {
+            if ( i + 1 >= argc )
+            {
+                std::cerr << "--save requires a value\n";
+                return 1;
+            }
+
+            save_path = argv[ i + 1 ];
+            i += 2;
+            continue;
+        }
+
+        if ( argv[ i ] == "--no-save"sv )
+        {
+            no_save = true;
+            ++i;
+            continue;
+        }
+
+        if ( argv[ i ] == "--solution-db"sv )
+        {
+            if ( i + 1 >= argc )
+            {
+                std::cerr << "--solution-db requires a value\n";
+                return 1;
+            }
+
+            if ( ! solution_db.open( argv[ i + 1 ] ) )
+            {
+                std::cerr << "Cannot read solution database " << argv[ i + 1 ] << "\n";
+                return 1;
+            }
+            i += 2;
+            continue;
+        }
+
+        if ( argv[ i ] == "--trace"sv )
+        {
+#ifdef FREECELL_TRACE
+            if ( i + 1 >= argc )
+            {
+                std::cerr << "--trace requires a value\n";
+                return 1;
+            }
+
+            trace_path = argv[ i + 1 ];
+            i += 2;
+            continue;
+#else
+            std::cerr << "--trace needs a build with tracing, see src/trace.h\n";
+            return 1;
+#endif
+        }
+
+        if ( argv[ i ] == "--fps"sv )
+        {
+            uint64_t fps = 0;
+            if ( i + 1 >= argc || ! parse_uint( argv[ i + 1 ], fps ) || fps < 1 || fps > 1000 )
+            {
+                std::cerr << "--fps requires a value between 1 and 1000\n";
+                return 1;
+            }
+
+            min_frame_interval = std::chrono::microseconds( 1000000 / fps );
+            i += 2;
+            continue;
+        }
+
+        if ( argv[ i ] == "--watch"sv )
+        {
+            watch = true;
+            ++i;
+            continue;
+        }
+
+        if ( argv[ i ] == "--solve"sv )
+        {
+            solve_mode = true;
+            ++i;
+            continue;
+        }
+
+        std::cerr << "Unknown argument: " << argv[ i ] << "\n";
+        return 1;
+    }
+
+    if ( analyze_mode )
+    {
+        return analyze_range( analyze_opts );
+    }
+
+    // Games played on a server are neither logged nor saved
+    if ( ! serve_path.empty() || ! connect_path.empty() )
+    {
+        if ( ! setup_signal_fd() )
+        {
+            std::cerr << "Cannot watch for terminal resizes\n";
+            return 1;
+        }
+        return serve_path.empty() ? play_remote( connect_path ) : serve_games( serve_path );
+    }
+
+    GameLog replay_log;
+    if ( ! replay_path.empty() )
+    {
+        if ( ! watch )
+        {
+            return replay_game( replay_path );
+        }
+
+        if ( ! read_game_log( replay_path, replay_log ) )
+        {
+            std::cerr << "Cannot read game log " << replay_path << "\n";
+            return 1;
+        }
+        player->game_seed = replay_log.seed;
+        player->ms_deal = replay_log.ms_deal;
+    }
+
+    if ( no_save )
+    {
+        save_path.clear();
+    }
+    else if ( save_path.empty() && getenv( "HOME" ) )
+    {
+        save_path = std::string( getenv( "HOME" ) ) + "/.freecell_save";
+    }
+
+    // A saved game is resumed unless another one is asked for. Logs start
+    // from a deal, so they always start a new game.
+    bool resumed = false;
+    if ( player->game_seed == 0 && ! solve_mode && log_path.empty() && ! save_path.empty() )
+    {
+        resumed = load_game( save_path, player->game_seed, player->ms_deal, player->game, player->history );
+    }
+
+    if ( player->game_seed == 0 )
+    {
+        std::random_device rd;
+        do {
+            player->game_seed = rd();
+        } while ( player->game_seed < 1000000 || player->game_seed > 9999999 );
+    }
+
+    if ( solve_mode )
+    {
+        return print_solution();
+    }
+
+    if ( ! log_path.empty() && ! game_log.open( log_path, player->game_seed, player->ms_deal ) )
+    {
+        std::cerr << "Cannot create " << log_path << "\n";
+        return 1;
+    }
+
+    if ( ! setup_signal_fd() )
+    {
+        std::cerr << "Cannot watch for terminal resizes\n";
+        return 1;
+    }
+
+    enter_terminal();
+
+    std::cerr << "Term width = " << player->term_size.ws_col << "\n";
+    std::cerr << "Term height = " << player->term_size.ws_row << "\n";
+
+    if ( watch )
+    {
+        start_game( replay_log, player->game, player->history );
+    }
+    else
+    {
+        if ( ! resumed )
+        {
+            deal_game( player->game );
+            player->history.reset( player->game );
+            auto_play_game();
+        }
+        hints = std::make_unique< HintWorker >();
+        load_known_solution();
+        game_changed();
+        player->term_out << csi::enable_mouse();
+    }
+
+    if ( watch )
+    {
+        watch_replay( replay_log );
+    }
+    else
+    {
+        run_game();
+        save_progress();
+    }
+
+    hints.reset();
+
+#ifdef FREECELL_TRACE
+    if ( ! trace_path.empty() && ! trace_buffer.dump( trace_path ) )
+    {
+        std::cerr << "Cannot write " << trace_path << "\n";
+    }
+#endif
+
+    const OutputStats &stats = player->term_out.stats();
+    std::cerr << "Frames = " << stats.frames
+              << ", bytes = " << stats.bytes
+              << ", syscalls = " << stats.syscalls << "\n";
+    if ( stats.frames )
+    {
+        std::cerr << "Bytes per frame = " << stats.bytes / stats.frames
+                  << ", syscalls per frame = " << static_cast< double >( stats.syscalls ) / stats.frames << "\n";
+    }
 
     std::cerr << "Bye!\n";
-    std::cout << csi::show_cursor() << csi::reset_alternate_screen();
-    tcsetattr( STDIN_FILENO, TCSANOW, &old_attr );
+    leave_terminal();
     std::cout << "Bye!\n";
 
     return 0;
 }
+#endif
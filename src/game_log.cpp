@@ -0,0 +1,180 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "game_log.h"
+
+#include "deal.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+const char log_magic[ 8 ] = { 'F', 'C', 'L', 'O', 'G', '0', '0', '1' };
+
+struct LogHeader
+{
+    char magic[ 8 ];
+    uint64_t seed;
+    uint32_t ms_deal;
+    uint32_t reserved;
+};
+
+static_assert( sizeof( LogHeader ) == 24, "Log header layout changed" );
+
+bool write_all( int fd, const void *data, size_t size )
+{
+    const char *p = static_cast< const char* >( data );
+    while ( size > 0 )
+    {
+        ssize_t res = write( fd, p, size );
+        if ( res < 0 )
+        {
+            if ( errno == EINTR )
+            {
+                continue;
+            }
+            return false;
+        }
+        p += res;
+        size -= res;
+    }
+    return true;
+}
+
+} // namespace
+
+GameLogWriter::~GameLogWriter()
+{
+    if ( m_fd >= 0 )
+    {
+        close( m_fd );
+    }
+}
+
+bool GameLogWriter::open( const std::string &path, uint64_t seed, bool ms_deal )
+{
+    int fd = ::open( path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644 );
+    if ( fd < 0 )
+    {
+        return false;
+    }
+
+    LogHeader header = {};
+    memcpy( header.magic, log_magic, sizeof( header.magic ) );
+    header.seed = seed;
+    header.ms_deal = ms_deal;
+
+    if ( ! write_all( fd, &header, sizeof( header ) ) )
+    {
+        close( fd );
+        return false;
+    }
+
+    if ( m_fd >= 0 )
+    {
+        close( m_fd );
+    }
+    m_fd = fd;
+    return true;
+}
+
+bool GameLogWriter::write_record( uint16_t record )
+{
+    return m_fd < 0 || write_all( m_fd, &record, sizeof( record ) );
+}
+
+bool read_game_log( const std::string &path, GameLog &log )
+{
+    FILE *f = fopen( path.c_str(), "rb" );
+    if ( ! f )
+    {
+        return false;
+    }
+
+    LogHeader header;
+    bool ok = fread( &header, sizeof( header ), 1, f ) == 1
+           && memcmp( header.magic, log_magic, sizeof( header.magic ) ) == 0;
+
+    log.records.clear();
+    uint16_t buf[ 4096 ];
+    size_t n;
+    while ( ok && ( n = fread( buf, sizeof( buf[ 0 ] ), 4096, f ) ) > 0 )
+    {
+        log.records.insert( log.records.end(), buf, buf + n );
+    }
+    ok = ok && ! ferror( f );
+    fclose( f );
+
+    log.seed = header.seed;
+    log.ms_deal = header.ms_deal;
+    return ok;
+}
+
+void start_game( const GameLog &log, GameState &st, History &history )
+{
+    if ( log.ms_deal )
+    {
+        deal_ms( st, log.seed );
+    }
+    else
+    {
+        deal( st, log.seed );
+    }
+    history.reset( st );
+}
+
+bool apply_record( uint16_t record, GameState &st, History &history )
+{
+    switch ( record )
+    {
+    case undo_record:
+        return history.undo( st );
+    case redo_record:
+        return history.redo( st );
+    case auto_play_record:
+        return history.auto_play( st ) > 0;
+    }
+
+    if ( record & 0x8000 )
+    {
+        return false;
+    }
+
+    // Logged moves were resolved by the game, so resolving them again must
+    // give the same move
+    const Move logged = decode_move( record );
+    if ( logged.from > Location::Foundation || logged.to > Location::Foundation
+      || logged.from_idx >= ( logged.from == Location::Cell ? 4 : 8 )
+      || logged.to_idx >= ( logged.to == Location::Cascade ? 8 : 4 ) )
+    {
+        return false;
+    }
+
+    Move m = logged;
+    if ( ! resolve_move( st, m ) || encode_move( m ) != record )
+    {
+        return false;
+    }
+
+    history.apply( st, m );
+    return true;
+}
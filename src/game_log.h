@@ -0,0 +1,84 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+// Recorded games.
+//
+// A log is a 24 byte header followed by one 2 byte record, in native byte
+// order, for every action of the player:
+//   - a move, as encoded by encode_move(), which never sets the top bit
+//   - undo_record or redo_record
+//   - auto_play_record, for cards moved by auto play, see History::auto_play()
+//
+// Records are only ever appended, each with its own write(2), so a log can
+// be followed while it is written, and a crash loses at most the action in
+// progress. A trailing partial record is ignored when reading.
+
+#include "engine.h"
+#include "history.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+const uint16_t undo_record = 0x8000;
+const uint16_t redo_record = 0x8001;
+const uint16_t auto_play_record = 0x8002;
+
+struct GameLog
+{
+    uint64_t seed = 0;
+    bool ms_deal = false; // Whether seed is a Microsoft deal number, see deal_ms()
+    std::vector< uint16_t > records;
+};
+
+class GameLogWriter
+{
+public:
+    GameLogWriter() = default;
+    GameLogWriter( const GameLogWriter& ) = delete;
+    GameLogWriter& operator=( const GameLogWriter& ) = delete;
+    ~GameLogWriter();
+
+    // Creates or truncates the file and writes the header. Returns false on
+    // error, leaving the writer closed.
+    bool open( const std::string &path, uint64_t seed, bool ms_deal );
+
+    bool is_open() const { return m_fd >= 0; }
+
+    // Do nothing if the writer is not open. Return false on write error.
+    bool write_move( const Move &m ) { return write_record( encode_move( m ) ); }
+    bool write_undo() { return write_record( undo_record ); }
+    bool write_redo() { return write_record( redo_record ); }
+    bool write_auto_play() { return write_record( auto_play_record ); }
+
+private:
+    bool write_record( uint16_t record );
+
+    int m_fd = -1;
+};
+
+// Returns false if the file cannot be read or is not a game log
+bool read_game_log( const std::string &path, GameLog &log );
+
+// Deals the game of the log into st and starts history from it
+void start_game( const GameLog &log, GameState &st, History &history );
+
+// Plays a record on st, the current position of history. Returns false,
+// leaving both unchanged, if the record is not a legal action there.
+bool apply_record( uint16_t record, GameState &st, History &history );
@@ -0,0 +1,201 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "hint_worker.h"
+
+#include "history.h"
+#include "packed_state.h"
+
+#include <system_error>
+
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace {
+
+// Hints have to come quickly to be of any use, so searches are kept short
+const size_t hint_max_positions = 200000;
+
+uint64_t pack_result( uint64_t generation, HintWorker::Status status, const Move &m )
+{
+    return ( generation & 0xffffffff ) | static_cast< uint64_t >( status ) << 32
+         | static_cast< uint64_t >( encode_move( m ) ) << 40;
+}
+
+} // namespace
+
+HintWorker::HintWorker()
+{
+    m_wake_fd = eventfd( 0, EFD_CLOEXEC );
+    if ( m_wake_fd < 0 || pipe2( m_notify_pipe, O_CLOEXEC | O_NONBLOCK ) != 0 )
+    {
+        throw std::system_error( errno, std::generic_category(), "HintWorker" );
+    }
+
+    for ( std::atomic< uint64_t > &w : m_position )
+    {
+        w.store( 0, std::memory_order_relaxed );
+    }
+
+    // Signals are for the UI thread, whose handlers are not written to run
+    // concurrently with it
+    sigset_t all, old;
+    sigfillset( &all );
+    pthread_sigmask( SIG_SETMASK, &all, &old );
+    m_thread = std::thread( [ this ] { run(); } );
+    pthread_sigmask( SIG_SETMASK, &old, nullptr );
+}
+
+HintWorker::~HintWorker()
+{
+    m_quit.store( true );
+    m_cancel.store( true );
+
+    uint64_t one = 1;
+    while ( write( m_wake_fd, &one, sizeof( one ) ) < 0 && errno == EINTR )
+    {
+    }
+    m_thread.join();
+
+    close( m_wake_fd );
+    close( m_notify_pipe[ 0 ] );
+    close( m_notify_pipe[ 1 ] );
+}
+
+void HintWorker::request( const GameState &st )
+{
+    const PackedState packed = pack( st );
+
+    // Only this thread writes, so the sequence can be bumped with plain stores
+    uint64_t seq = m_sequence.load( std::memory_order_relaxed );
+    m_sequence.store( seq + 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+    for ( size_t i = 0; i < packed.m_words.size(); ++i )
+    {
+        m_position[ i ].store( packed.m_words[ i ], std::memory_order_relaxed );
+    }
+    m_sequence.store( seq + 2, std::memory_order_release );
+
+    m_cancel.store( true );
+
+    // Never blocks, the counter just saturates if the worker is behind
+    uint64_t one = 1;
+    while ( write( m_wake_fd, &one, sizeof( one ) ) < 0 && errno == EINTR )
+    {
+    }
+}
+
+HintWorker::Hint HintWorker::result() const
+{
+    const uint64_t generation = m_sequence.load( std::memory_order_relaxed ) / 2;
+    const uint64_t res = m_result.load( std::memory_order_acquire );
+
+    Hint hint;
+    if ( ( res & 0xffffffff ) == ( generation & 0xffffffff ) )
+    {
+        hint.status = static_cast< Status >( ( res >> 32 ) & 0xff );
+        hint.move = decode_move( res >> 40 );
+    }
+    return hint;
+}
+
+void HintWorker::run()
+{
+    SolverOptions opts;
+    opts.max_positions = hint_max_positions;
+    opts.cancel = &m_cancel;
+    Solver solver( opts );
+
+    uint64_t searched = 0; // Generation of the last position searched
+
+    while ( ! m_quit.load() )
+    {
+        if ( m_sequence.load( std::memory_order_acquire ) / 2 == searched )
+        {
+            uint64_t count;
+            if ( read( m_wake_fd, &count, sizeof( count ) ) < 0 && errno != EINTR )
+            {
+                return;
+            }
+            continue;
+        }
+
+        // Read a consistent copy of the position
+        PackedState packed;
+        uint64_t seq;
+        while ( true )
+        {
+            seq = m_sequence.load( std::memory_order_acquire );
+            for ( size_t i = 0; i < packed.m_words.size(); ++i )
+            {
+                packed.m_words[ i ] = m_position[ i ].load( std::memory_order_relaxed );
+            }
+            std::atomic_thread_fence( std::memory_order_acquire );
+            if ( seq % 2 == 0 && m_sequence.load( std::memory_order_relaxed ) == seq )
+            {
+                break;
+            }
+        }
+        searched = seq / 2;
+
+        // A request made after this point sets it again, and is picked up by
+        // the check below or the next iteration
+        m_cancel.store( false );
+        if ( m_sequence.load() != seq )
+        {
+            continue;
+        }
+
+        GameState st;
+        unpack( packed, st );
+
+        Status status = Status::Unknown;
+        Move move;
+        if ( ! is_full_foundations( st ) )
+        {
+            SolveResult res = solver.solve( st );
+            if ( m_sequence.load() != seq )
+            {
+                continue; // Cancelled, or a newer position is waiting anyway
+            }
+
+            switch ( res.status )
+            {
+            case SolveStatus::Solved:
+                status = Status::Solvable;
+                move = res.moves.front();
+                break;
+            case SolveStatus::Unsolvable:
+                status = Status::DeadEnd;
+                break;
+            case SolveStatus::LimitReached:
+                break;
+            }
+        }
+
+        m_result.store( pack_result( searched, status, move ), std::memory_order_release );
+
+        char byte = 0;
+        while ( write( m_notify_pipe[ 1 ], &byte, 1 ) < 0 && errno == EINTR )
+        {
+        }
+    }
+}
@@ -0,0 +1,86 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "engine.h"
+#include "solver.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+// Searches the position the player is looking at on a background thread.
+//
+// Neither request() nor result() ever block or take a lock, so key handling
+// is not slowed down by a search in progress. A new request cancels the
+// search for the previous one.
+class HintWorker
+{
+public:
+    enum class Status : uint8_t
+    {
+        Thinking, // No result for the latest position yet
+        Solvable,
+        DeadEnd,  // No way to win from here
+        Unknown,  // Gave up searching
+    };
+
+    struct Hint
+    {
+        Status status = Status::Thinking;
+        Move move; // First move of a solution, if solvable
+    };
+
+    HintWorker();
+    ~HintWorker();
+
+    HintWorker( const HintWorker& ) = delete;
+    HintWorker& operator=( const HintWorker& ) = delete;
+
+    // Starts searching from st, dropping any earlier request
+    void request( const GameState &st );
+
+    // Result for the latest request
+    Hint result() const;
+
+    // Becomes readable when a new result is published. Each result writes a
+    // byte, which the caller should read to clear the notification.
+    int notify_fd() const { return m_notify_pipe[ 0 ]; }
+
+private:
+    void run();
+
+    // Position to search, written by request() under a sequence lock: the
+    // sequence is odd while it is being written, and the generation of the
+    // request is half the sequence.
+    std::atomic< uint64_t > m_sequence{ 0 };
+    std::array< std::atomic< uint64_t >, 7 > m_position; // PackedState words
+
+    // Generation, status and move of the latest result, packed so that it is
+    // published with a single store
+    std::atomic< uint64_t > m_result{ 0 };
+
+    std::atomic< bool > m_cancel{ false };
+    std::atomic< bool > m_quit{ false };
+
+    int m_wake_fd = -1; // eventfd
+    int m_notify_pipe[ 2 ] = { -1, -1 };
+
+    std::thread m_thread;
+};
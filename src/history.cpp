@@ -0,0 +1,129 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "history.h"
+
+uint16_t encode_move( const Move &m )
+{
+    return static_cast< uint16_t >( m.from )
+         | m.from_idx << 2
+         | static_cast< uint16_t >( m.to ) << 5
+         | m.to_idx << 7
+         | m.count << 10;
+}
+
+Move decode_move( uint16_t code )
+{
+    Move m;
+    m.from = static_cast< Location >( code & 0x3 );
+    m.from_idx = ( code >> 2 ) & 0x7;
+    m.to = static_cast< Location >( ( code >> 5 ) & 0x3 );
+    m.to_idx = ( code >> 7 ) & 0x7;
+    m.count = ( code >> 10 ) & 0x1f;
+    return m;
+}
+
+void History::reset( const GameState &start )
+{
+    m_moves.clear();
+    m_snapshots.clear();
+    m_snapshots.push_back( pack( start ) );
+    m_pos = 0;
+}
+
+void History::apply( GameState &st, const Move &m, bool joined )
+{
+    apply_move( st, m );
+
+    // Drop the moves that could be redone, and the snapshots taken after them
+    m_moves.resize( m_pos );
+    m_snapshots.resize( m_pos / snapshot_interval + 1 );
+
+    m_moves.push_back( encode_move( m ) | ( joined && m_pos > 0 ? joined_bit : 0 ) );
+    ++m_pos;
+
+    if ( m_pos % snapshot_interval == 0 )
+    {
+        m_snapshots.push_back( pack( st ) );
+    }
+}
+
+int History::auto_play( GameState &st )
+{
+    int count = 0;
+    Move m;
+    while ( find_safe_move( st, m ) )
+    {
+        apply( st, m, true );
+        ++count;
+    }
+    return count;
+}
+
+bool History::undo( GameState &st )
+{
+    if ( m_pos == 0 )
+    {
+        return false;
+    }
+
+    do
+    {
+        --m_pos;
+        undo_move( st, move( m_pos ) );
+    } while ( is_joined( m_pos ) );
+    return true;
+}
+
+bool History::redo( GameState &st )
+{
+    if ( m_pos == m_moves.size() )
+    {
+        return false;
+    }
+
+    do
+    {
+        apply_move( st, move( m_pos ) );
+        ++m_pos;
+    } while ( m_pos < m_moves.size() && is_joined( m_pos ) );
+    return true;
+}
+
+void History::state_at( size_t ply, GameState &st ) const
+{
+    size_t snapshot = ply / snapshot_interval;
+    unpack( m_snapshots[ snapshot ], st );
+
+    for ( size_t i = snapshot * snapshot_interval; i < ply; ++i )
+    {
+        apply_move( st, move( i ) );
+    }
+}
+
+bool History::restore( const uint16_t *moves, size_t num_moves, const PackedState *snapshots, size_t num_snapshots, size_t pos )
+{
+    if ( pos > num_moves || num_snapshots != num_moves / snapshot_interval + 1 )
+    {
+        return false;
+    }
+
+    m_moves.assign( moves, moves + num_moves );
+    m_snapshots.assign( snapshots, snapshots + num_snapshots );
+    m_pos = pos;
+    return true;
+}
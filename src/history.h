@@ -0,0 +1,95 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+// Moves played in a game, for undo and redo.
+//
+// Each move is stored in two bytes. Moves can be joined to the one before,
+// so that a move and the cards auto played after it are a single step for
+// undo and redo. Undoing or redoing a move only touches
+// the cards moved, so its cost does not depend on the size of the state. The
+// position is also saved every snapshot_interval moves, so that any point of
+// a long game can be restored without replaying it from the start.
+
+#include "engine.h"
+#include "packed_state.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Two byte form of a Move, from the least significant bit:
+//   from (2 bit), from_idx (3 bit), to (2 bit), to_idx (3 bit), count (5 bit)
+uint16_t encode_move( const Move &m );
+Move decode_move( uint16_t code );
+
+class History
+{
+public:
+    static constexpr size_t snapshot_interval = 256;
+
+    // Starts a new game from given position
+    void reset( const GameState &start );
+
+    // Applies a legal move to st, which must be the current position, and
+    // records it. Moves that were undone can no longer be redone after this.
+    void apply( GameState &st, const Move &m, bool joined = false );
+
+    // Applies and records safe moves to foundations (see auto_play()), joined
+    // to the last move if there is one. Returns the number of moves made.
+    int auto_play( GameState &st );
+
+    // Take st, the current position, one step back or forward. Return false
+    // if there is no such step.
+    bool undo( GameState &st );
+    bool redo( GameState &st );
+
+    // Number of moves recorded, including the ones that can be redone
+    size_t size() const { return m_moves.size(); }
+
+    // Number of moves from the start to the current position
+    size_t position() const { return m_pos; }
+
+    Move move( size_t idx ) const { return decode_move( m_moves[ idx ] & ~joined_bit ); }
+
+    // Position after the first ply moves, ply <= size()
+    void state_at( size_t ply, GameState &st ) const;
+
+    // Contents as stored, for saving a game in progress. Moves are as
+    // encoded by encode_move(), with the top bit set on joined ones.
+    const std::vector< uint16_t >& raw_moves() const { return m_moves; }
+    const std::vector< PackedState >& raw_snapshots() const { return m_snapshots; }
+
+    // Takes contents saved from raw_moves() and raw_snapshots(). Returns
+    // false, leaving history unchanged, if their sizes do not match each
+    // other or pos.
+    bool restore( const uint16_t *moves, size_t num_moves, const PackedState *snapshots, size_t num_snapshots, size_t pos );
+
+private:
+    // Set on moves joined to the previous one. Never set by encode_move().
+    static const uint16_t joined_bit = 0x8000;
+
+    bool is_joined( size_t idx ) const { return m_moves[ idx ] & joined_bit; }
+
+    std::vector< uint16_t > m_moves;
+
+    // Position after i * snapshot_interval moves
+    std::vector< PackedState > m_snapshots;
+
+    size_t m_pos = 0;
+};
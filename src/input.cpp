@@ -0,0 +1,449 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "input.h"
+
+#include <array>
+
+namespace {
+
+constexpr uint8_t esc = 0x1b;
+constexpr uint32_t replacement_char = 0xfffd;
+
+// Keys for the final byte of CSI and SS3 sequences, such as ESC [ A or ESC O P
+constexpr std::array< InputKey, 128 > make_final_byte_keys()
+{
+    std::array< InputKey, 128 > keys = {};
+    keys[ 'A' ] = InputKey::Up;
+    keys[ 'B' ] = InputKey::Down;
+    keys[ 'C' ] = InputKey::Right;
+    keys[ 'D' ] = InputKey::Left;
+    keys[ 'H' ] = InputKey::Home;
+    keys[ 'F' ] = InputKey::End;
+    keys[ 'P' ] = InputKey::F1;
+    keys[ 'Q' ] = InputKey::F2;
+    keys[ 'R' ] = InputKey::F3;
+    keys[ 'S' ] = InputKey::F4;
+    keys[ 'Z' ] = InputKey::BackTab;
+    keys[ 'M' ] = InputKey::Enter; // Keypad enter, SS3 only
+    return keys;
+}
+
+// Keys for the number of ESC [ n ~ sequences
+constexpr std::array< InputKey, 35 > make_tilde_keys()
+{
+    std::array< InputKey, 35 > keys = {};
+    keys[ 1 ] = InputKey::Home;
+    keys[ 2 ] = InputKey::Insert;
+    keys[ 3 ] = InputKey::Delete;
+    keys[ 4 ] = InputKey::End;
+    keys[ 5 ] = InputKey::PageUp;
+    keys[ 6 ] = InputKey::PageDown;
+    keys[ 7 ] = InputKey::Home;
+    keys[ 8 ] = InputKey::End;
+    keys[ 11 ] = InputKey::F1;
+    keys[ 12 ] = InputKey::F2;
+    keys[ 13 ] = InputKey::F3;
+    keys[ 14 ] = InputKey::F4;
+    keys[ 15 ] = InputKey::F5;
+    keys[ 17 ] = InputKey::F6;
+    keys[ 18 ] = InputKey::F7;
+    keys[ 19 ] = InputKey::F8;
+    keys[ 20 ] = InputKey::F9;
+    keys[ 21 ] = InputKey::F10;
+    keys[ 23 ] = InputKey::F11;
+    keys[ 24 ] = InputKey::F12;
+    return keys;
+}
+
+constexpr std::array< InputKey, 128 > final_byte_keys = make_final_byte_keys();
+constexpr std::array< InputKey, 35 > tilde_keys = make_tilde_keys();
+
+constexpr uint16_t paste_begin = 200;
+constexpr char paste_end_marker[] = "\033[201~";
+constexpr int paste_end_marker_size = sizeof( paste_end_marker ) - 1;
+
+// Modifier parameter of a sequence, 1 + the modifier bits, to the bits
+uint8_t modifier_bits( uint16_t param )
+{
+    return param > 1 ? ( param - 1 ) & 0xf : 0;
+}
+
+} // namespace
+
+void InputDecoder::reset_params()
+{
+    for ( uint16_t &p : m_params )
+    {
+        p = 0;
+    }
+    m_num_params = 1;
+    m_private = 0;
+    m_intermediate = false;
+    m_has_digits = false;
+}
+
+void InputDecoder::emit( InputKey key, uint32_t ch, uint8_t modifiers, std::vector< InputEvent > &events )
+{
+    InputEvent ev;
+    ev.key = key;
+    ev.ch = ch;
+    ev.modifiers = modifiers | ( m_alt ? InputModifier::Alt : 0 );
+    ev.pasted = m_in_paste;
+    events.push_back( ev );
+    m_alt = false;
+}
+
+// cb is the button byte as xterm numbers it: the button in the low two bits,
+// modifiers in the next three, then motion and wheel flags
+void InputDecoder::emit_mouse( int cb, int x, int y, bool release, std::vector< InputEvent > &events )
+{
+    InputEvent ev;
+    ev.key = InputKey::Mouse;
+    ev.modifiers = ( cb & 4 ? InputModifier::Shift : 0 )
+                 | ( cb & 8 ? InputModifier::Alt : 0 )
+                 | ( cb & 16 ? InputModifier::Ctrl : 0 );
+    ev.button = cb & 3;
+    ev.row = y > 0 ? y - 1 : 0;
+    ev.col = x > 0 ? x - 1 : 0;
+
+    if ( cb & 128 )
+    {
+        return; // Buttons 8 and up
+    }
+    else if ( cb & 64 )
+    {
+        if ( ev.button > 1 )
+        {
+            return; // Horizontal scrolling
+        }
+        ev.action = ( ev.button == 0 ? MouseAction::WheelUp : MouseAction::WheelDown );
+    }
+    else if ( cb & 32 )
+    {
+        ev.action = ( ev.button == 3 ? MouseAction::Move : MouseAction::Drag );
+    }
+    else if ( release || ev.button == 3 )
+    {
+        ev.action = MouseAction::Release;
+    }
+    else
+    {
+        ev.action = MouseAction::Press;
+    }
+
+    events.push_back( ev );
+    m_alt = false;
+}
+
+void InputDecoder::ground( uint8_t b, std::vector< InputEvent > &events )
+{
+    if ( b == esc )
+    {
+        if ( m_in_paste )
+        {
+            m_state = State::PasteEscape;
+            m_paste_matched = 1;
+        }
+        else
+        {
+            m_state = State::Escape;
+        }
+        return;
+    }
+
+    if ( b < 0x80 )
+    {
+        switch ( b )
+        {
+        case '\r': case '\n': emit( InputKey::Enter, 0, 0, events ); return;
+        case '\t':            emit( InputKey::Tab, 0, 0, events ); return;
+        case 0x7f: case 0x08: emit( InputKey::Backspace, 0, 0, events ); return;
+        }
+
+        if ( b < 0x20 )
+        {
+            // Ctrl with a letter, with one of \ ] ^ _ for 0x1c to 0x1f, or
+            // with space for 0
+            const uint32_t ch = ( b == 0 ? ' ' : b <= 0x1a ? b | 0x60 : b + 0x40 );
+            emit( InputKey::Char, ch, InputModifier::Ctrl, events );
+            return;
+        }
+
+        emit( InputKey::Char, b, 0, events );
+        return;
+    }
+
+    // Lead byte of a multi byte character. Overlong forms are let through,
+    // they are harmless here.
+    if ( b >= 0xc2 && b <= 0xdf )
+    {
+        m_code_point = b & 0x1f;
+        m_utf8_left = 1;
+    }
+    else if ( b >= 0xe0 && b <= 0xef )
+    {
+        m_code_point = b & 0x0f;
+        m_utf8_left = 2;
+    }
+    else if ( b >= 0xf0 && b <= 0xf4 )
+    {
+        m_code_point = b & 0x07;
+        m_utf8_left = 3;
+    }
+    else
+    {
+        emit( InputKey::Char, replacement_char, 0, events );
+        return;
+    }
+    m_state = State::Utf8;
+}
+
+void InputDecoder::finish_csi( uint8_t final_byte, std::vector< InputEvent > &events )
+{
+    m_state = State::Ground;
+
+    if ( m_private == '<' && ( final_byte == 'M' || final_byte == 'm' ) && m_num_params == 3 )
+    {
+        // SGR mouse report: ESC [ < button ; x ; y M, m on release
+        emit_mouse( m_params[ 0 ], m_params[ 1 ], m_params[ 2 ], final_byte == 'm', events );
+        return;
+    }
+
+    if ( m_private || m_intermediate )
+    {
+        return; // Replies to queries, which are never sent
+    }
+
+    if ( final_byte == 'M' && ! m_has_digits && m_num_params == 1 )
+    {
+        // Legacy mouse report, followed by three raw bytes
+        m_state = State::X10Mouse;
+        m_num_params = 0;
+        return;
+    }
+
+    InputKey key = InputKey::None;
+    if ( final_byte == '~' )
+    {
+        if ( m_params[ 0 ] == paste_begin )
+        {
+            m_in_paste = true;
+            return;
+        }
+        if ( m_params[ 0 ] < tilde_keys.size() )
+        {
+            key = tilde_keys[ m_params[ 0 ] ];
+        }
+    }
+    else if ( final_byte != 'M' )
+    {
+        key = final_byte_keys[ final_byte ];
+    }
+
+    if ( key != InputKey::None )
+    {
+        emit( key, 0, modifier_bits( m_params[ 1 ] ), events );
+    }
+}
+
+void InputDecoder::feed( const char *data, size_t size, std::vector< InputEvent > &events )
+{
+    for ( size_t i = 0; i < size; ++i )
+    {
+        const uint8_t b = data[ i ];
+
+        switch ( m_state )
+        {
+        case State::Ground:
+            ground( b, events );
+            break;
+
+        case State::Escape:
+            if ( b == '[' )
+            {
+                m_state = State::Csi;
+                reset_params();
+            }
+            else if ( b == 'O' )
+            {
+                m_state = State::Ss3;
+                reset_params();
+            }
+            else if ( b == esc )
+            {
+                // Alt with a key that starts with escape itself
+                m_alt = true;
+            }
+            else
+            {
+                m_alt = true;
+                m_state = State::Ground;
+                ground( b, events );
+            }
+            break;
+
+        case State::Csi:
+            if ( b >= '0' && b <= '9' )
+            {
+                if ( ! m_intermediate && m_num_params <= max_params )
+                {
+                    uint16_t &p = m_params[ m_num_params - 1 ];
+                    p = ( p < 10000 ? p * 10 + ( b - '0' ) : p );
+                    m_has_digits = true;
+                }
+            }
+            else if ( b == ';' || b == ':' )
+            {
+                // Extra parameters are read but ignored
+                m_num_params += ( m_num_params <= max_params );
+            }
+            else if ( b >= '<' && b <= '?' )
+            {
+                m_private = b;
+            }
+            else if ( b >= 0x20 && b <= 0x2f )
+            {
+                m_intermediate = true;
+            }
+            else if ( b >= 0x40 && b <= 0x7e )
+            {
+                finish_csi( b, events );
+                m_alt = false;
+            }
+            else
+            {
+                // Not part of a sequence, which so ends early
+                m_state = State::Ground;
+                m_alt = false;
+                ground( b, events );
+            }
+            break;
+
+        case State::Ss3:
+            if ( b >= '0' && b <= '9' )
+            {
+                // Some terminals put the modifier here, as in ESC O 5 A
+                m_params[ 1 ] = m_params[ 1 ] * 10 % 10000 + ( b - '0' );
+                m_has_digits = true;
+            }
+            else if ( b >= 0x40 && b <= 0x7e )
+            {
+                m_state = State::Ground;
+                if ( final_byte_keys[ b ] != InputKey::None )
+                {
+                    emit( final_byte_keys[ b ], 0, modifier_bits( m_params[ 1 ] ), events );
+                }
+                m_alt = false;
+            }
+            else
+            {
+                m_state = State::Ground;
+                m_alt = false;
+                ground( b, events );
+            }
+            break;
+
+        case State::X10Mouse:
+            // Each value is offset by 32
+            m_params[ m_num_params++ ] = b;
+            if ( m_num_params == 3 )
+            {
+                m_state = State::Ground;
+                emit_mouse( m_params[ 0 ] - 32, m_params[ 1 ] - 32, m_params[ 2 ] - 32, false, events );
+            }
+            break;
+
+        case State::Utf8:
+            if ( ( b & 0xc0 ) == 0x80 )
+            {
+                m_code_point = ( m_code_point << 6 ) | ( b & 0x3f );
+                if ( --m_utf8_left == 0 )
+                {
+                    m_state = State::Ground;
+                    emit( InputKey::Char, m_code_point, 0, events );
+                }
+            }
+            else
+            {
+                m_state = State::Ground;
+                emit( InputKey::Char, replacement_char, 0, events );
+                ground( b, events );
+            }
+            break;
+
+        case State::PasteEscape:
+            if ( b == static_cast< uint8_t >( paste_end_marker[ m_paste_matched ] ) )
+            {
+                if ( ++m_paste_matched == paste_end_marker_size )
+                {
+                    m_state = State::Ground;
+                    m_in_paste = false;
+                }
+            }
+            else
+            {
+                // Pasted text after all, which is taken literally
+                m_state = State::Ground;
+                emit( InputKey::Escape, 0, 0, events );
+                for ( int j = 1; j < m_paste_matched; ++j )
+                {
+                    ground( paste_end_marker[ j ], events );
+                }
+                ground( b, events );
+            }
+            break;
+        }
+    }
+}
+
+void InputDecoder::flush( std::vector< InputEvent > &events )
+{
+    switch ( m_state )
+    {
+    case State::Ground:
+        break;
+    case State::Escape:
+        emit( InputKey::Escape, 0, 0, events ); // With Alt after two escapes
+        break;
+    case State::Csi:
+    case State::Ss3:
+        if ( m_num_params == 1 && ! m_has_digits && ! m_private && ! m_intermediate )
+        {
+            m_alt = true;
+            emit( InputKey::Char, m_state == State::Csi ? '[' : 'O', 0, events );
+        }
+        break;
+    case State::X10Mouse:
+        break;
+    case State::Utf8:
+        emit( InputKey::Char, replacement_char, 0, events );
+        break;
+    case State::PasteEscape:
+        m_state = State::Ground;
+        emit( InputKey::Escape, 0, 0, events );
+        for ( int j = 1; j < m_paste_matched; ++j )
+        {
+            ground( paste_end_marker[ j ], events );
+        }
+        break;
+    }
+
+    m_state = State::Ground;
+    m_in_paste = false;
+    m_alt = false;
+}
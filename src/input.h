@@ -0,0 +1,142 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+// Decoding of the bytes read from the terminal into key presses and mouse
+// reports.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum class InputKey : uint8_t
+{
+    None,
+    Char, // Text, the code point is in InputEvent::ch
+    Enter,
+    Tab,
+    BackTab,
+    Backspace,
+    Escape,
+    Up,
+    Down,
+    Right,
+    Left,
+    Home,
+    End,
+    Insert,
+    Delete,
+    PageUp,
+    PageDown,
+    F1, F2, F3, F4, F5, F6, F7, F8, F9, F10, F11, F12,
+    Mouse,
+};
+
+// Bits of InputEvent::modifiers, as numbered by xterm
+enum InputModifier : uint8_t
+{
+    Shift = 1,
+    Alt = 2,
+    Ctrl = 4,
+    Meta = 8,
+};
+
+enum class MouseAction : uint8_t
+{
+    Press,
+    Release,
+    Drag, // Moved with a button held
+    Move, // Moved with no button held
+    WheelUp,
+    WheelDown,
+};
+
+struct InputEvent
+{
+    InputKey key = InputKey::None;
+    uint8_t modifiers = 0;
+    bool pasted = false; // Part of a bracketed paste rather than typed
+    uint32_t ch = 0;
+
+    // For InputKey::Mouse. Buttons are 0 left, 1 middle, 2 right, and 3 for
+    // a release when the terminal does not report which button it was.
+    MouseAction action = MouseAction::Press;
+    uint8_t button = 0;
+    uint16_t row = 0; // 0 based
+    uint16_t col = 0;
+};
+
+// Turns terminal input into events in a single pass, one byte at a time.
+//
+// Escape sequences may be split across reads in any way, the decoder keeps
+// the partial sequence until the rest arrives. Sequences that are well formed
+// but not recognized are dropped as a whole, without affecting what follows.
+class InputDecoder
+{
+public:
+    // Decodes data, appending complete events to events
+    void feed( const char *data, size_t size, std::vector< InputEvent > &events );
+
+    // True when the input so far ends in the middle of a sequence, or inside
+    // a bracketed paste
+    bool pending() const { return m_state != State::Ground || m_in_paste; }
+
+    // Ends whatever is pending, for when no more input came for it in time.
+    // A lone escape is the Escape key, and an escape followed by another
+    // character that alone would start a sequence is that character with
+    // Alt. Ends a bracketed paste too, so that a lost end marker does not
+    // turn every later key into pasted text.
+    void flush( std::vector< InputEvent > &events );
+
+private:
+    enum class State : uint8_t
+    {
+        Ground,
+        Escape,
+        Csi,
+        Ss3,
+        X10Mouse,    // ESC [ M and three raw bytes
+        Utf8,
+        PasteEscape, // Possible end of a bracketed paste
+    };
+
+    void ground( uint8_t b, std::vector< InputEvent > &events );
+    void finish_csi( uint8_t final_byte, std::vector< InputEvent > &events );
+    void emit( InputKey key, uint32_t ch, uint8_t modifiers, std::vector< InputEvent > &events );
+    void emit_mouse( int cb, int x, int y, bool release, std::vector< InputEvent > &events );
+    void reset_params();
+
+    State m_state = State::Ground;
+    bool m_in_paste = false;
+    bool m_alt = false; // Escape before a key
+
+    // Control sequence being read
+    static constexpr int max_params = 4;
+    uint16_t m_params[ max_params ] = {};
+    uint8_t m_num_params = 0;
+    uint8_t m_private = 0; // Private marker such as '<' or '?', 0 if none
+    bool m_intermediate = false;
+    bool m_has_digits = false;
+
+    // UTF-8 character being read
+    uint32_t m_code_point = 0;
+    uint8_t m_utf8_left = 0;
+
+    // Bytes of the paste end marker matched so far
+    uint8_t m_paste_matched = 0;
+};
@@ -0,0 +1,398 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+// Load generator for the game server (freecell --serve). Starts a server,
+// plays many sessions on it at once, each pressing a key at a steady rate,
+// and prints as JSON how long frames took to start arriving after a key, and
+// how much CPU the server used meanwhile.
+
+#include "protocol.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <queue>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+const char usage[] = R"(
+usage: freecell_load [--server PATH] [--sessions N] [--seconds N] [--rate N]
+
+  --server    freecell binary to start (default ./freecell)
+  --sessions  number of sessions played at once (default 1000)
+  --seconds   how long to play once every session is started (default 10)
+  --rate      keys pressed per second in each session (default 5)
+)";
+
+using Clock = std::chrono::steady_clock;
+
+// Terminal size every session reports, enough for a whole frame
+const uint16_t term_rows = 50;
+const uint16_t term_cols = 100;
+
+struct Client
+{
+    int fd = -1;
+    bool waiting = false;    // For the frame of the last key
+    bool right = true;       // Next key, the cursor moves back and forth
+    Clock::time_point sent;
+};
+
+bool send_all( int fd, const std::string &data )
+{
+    size_t sent = 0;
+    while ( sent < data.size() )
+    {
+        ssize_t res = send( fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL );
+        if ( res < 0 )
+        {
+            if ( errno == EINTR || errno == EAGAIN )
+            {
+                continue;
+            }
+            return false;
+        }
+        sent += res;
+    }
+    return true;
+}
+
+int connect_to( const std::string &path )
+{
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    std::copy( path.begin(), path.end(), addr.sun_path );
+
+    int fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+    if ( fd >= 0 && connect( fd, reinterpret_cast< struct sockaddr* >( &addr ), sizeof( addr ) ) != 0 )
+    {
+        close( fd );
+        fd = -1;
+    }
+    return fd;
+}
+
+// User and system time of a running process, from /proc
+double cpu_seconds( pid_t pid )
+{
+    FILE *f = fopen( ( "/proc/" + std::to_string( pid ) + "/stat" ).c_str(), "r" );
+    if ( ! f )
+    {
+        return 0;
+    }
+
+    char line[ 1024 ];
+    unsigned long utime = 0, stime = 0;
+    if ( fgets( line, sizeof( line ), f ) )
+    {
+        // Fields 14 and 15, counted after the name which may contain spaces
+        const char *rest = strrchr( line, ')' );
+        if ( rest )
+        {
+            sscanf( rest + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime );
+        }
+    }
+    fclose( f );
+    return static_cast< double >( utime + stime ) / sysconf( _SC_CLK_TCK );
+}
+
+double percentile( const std::vector< double > &sorted, double p )
+{
+    return sorted.empty() ? 0 : sorted[ std::min( sorted.size() - 1, static_cast< size_t >( p * sorted.size() ) ) ];
+}
+
+bool parse_arg( int argc, char *argv[], int &i, int &val, int max )
+{
+    if ( i + 1 >= argc || ( val = atoi( argv[ i + 1 ] ) ) < 1 || val > max )
+    {
+        std::cerr << argv[ i ] << " requires a value between 1 and " << max << "\n";
+        return false;
+    }
+    ++i;
+    return true;
+}
+
+} // namespace
+
+int main( int argc, char* argv[] )
+{
+    using namespace std::literals;
+
+    std::string server = "./freecell";
+    int num_sessions = 1000;
+    int seconds = 10;
+    int rate = 5;
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        if ( argv[ i ] == "--help"sv )
+        {
+            std::cerr << usage + 1;
+            return 0;
+        }
+        else if ( argv[ i ] == "--server"sv && i + 1 < argc )
+        {
+            server = argv[ ++i ];
+        }
+        else if ( argv[ i ] == "--sessions"sv )
+        {
+            if ( ! parse_arg( argc, argv, i, num_sessions, 1000000 ) )
+            {
+                return 1;
+            }
+        }
+        else if ( argv[ i ] == "--seconds"sv )
+        {
+            if ( ! parse_arg( argc, argv, i, seconds, 3600 ) )
+            {
+                return 1;
+            }
+        }
+        else if ( argv[ i ] == "--rate"sv )
+        {
+            if ( ! parse_arg( argc, argv, i, rate, 1000 ) )
+            {
+                return 1;
+            }
+        }
+        else
+        {
+            std::cerr << "Unknown argument: " << argv[ i ] << "\n";
+            return 1;
+        }
+    }
+
+    // Each session is a file descriptor here and in the server
+    struct rlimit limit;
+    if ( getrlimit( RLIMIT_NOFILE, &limit ) == 0 && limit.rlim_cur < limit.rlim_max )
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit( RLIMIT_NOFILE, &limit );
+    }
+
+    const std::string path = "/tmp/freecell_load." + std::to_string( getpid() ) + ".sock";
+    const pid_t pid = fork();
+    if ( pid == 0 )
+    {
+        execl( server.c_str(), server.c_str(), "--serve", path.c_str(), static_cast< char* >( nullptr ) );
+        std::cerr << "Cannot run " << server << "\n";
+        _exit( 1 );
+    }
+    if ( pid < 0 )
+    {
+        std::cerr << "Cannot start the server\n";
+        return 1;
+    }
+
+    auto stop_server = [ & ]( struct rusage &res_usage )
+    {
+        kill( pid, SIGTERM );
+        int status;
+        return wait4( pid, &status, 0, &res_usage ) == pid && WIFEXITED( status ) && WEXITSTATUS( status ) == 0;
+    };
+
+    // Until the server listens
+    int fd = -1;
+    for ( int tries = 0; tries < 100 && ( fd = connect_to( path ) ) < 0; ++tries )
+    {
+        std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+    }
+    if ( fd < 0 )
+    {
+        std::cerr << "Cannot connect to the server\n";
+        struct rusage res_usage;
+        stop_server( res_usage );
+        return 1;
+    }
+
+    std::string start_msg;
+    StartPayload start = {};
+    start.rows = term_rows;
+    start.cols = term_cols;
+    append_message( start_msg, ClientMessage::Start, &start, sizeof( start ) );
+
+    std::string key_msgs[ 2 ];
+    append_message( key_msgs[ 0 ], ClientMessage::Input, "\033[D", 3 ); // Left
+    append_message( key_msgs[ 1 ], ClientMessage::Input, "\033[C", 3 ); // Right
+
+    const int epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+    std::vector< Client > clients( num_sessions );
+    for ( int i = 0; i < num_sessions; ++i )
+    {
+        Client &c = clients[ i ];
+        c.fd = ( i == 0 ? fd : connect_to( path ) );
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u32 = i;
+        if ( c.fd < 0 || ! send_all( c.fd, start_msg ) || epoll_ctl( epoll_fd, EPOLL_CTL_ADD, c.fd, &ev ) != 0 )
+        {
+            std::cerr << "Cannot open session " << i + 1 << "\n";
+            struct rusage res_usage;
+            stop_server( res_usage );
+            return 1;
+        }
+        fcntl( c.fd, F_SETFL, O_NONBLOCK );
+    }
+
+    // Keys are spread evenly over time, each session at a random phase
+    struct Timer
+    {
+        Clock::time_point when;
+        int client;
+        bool operator>( const Timer &t ) const { return when > t.when; }
+    };
+    std::priority_queue< Timer, std::vector< Timer >, std::greater< Timer > > timers;
+    const Clock::duration interval = std::chrono::microseconds( 1000000 / rate );
+    std::mt19937 rng( 42 );
+
+    std::vector< double > latencies; // Milliseconds
+    uint64_t keys = 0;
+    uint64_t late_keys = 0; // Due while the last frame had not arrived
+    uint64_t bytes = 0;
+    bool ok = true;
+    std::vector< struct epoll_event > events( 256 );
+    char buf[ 64 * 1024 ];
+
+    // Reads what arrived for the ready sessions, returns false if one was closed
+    auto receive = [ & ]( int n, Clock::time_point now )
+    {
+        for ( int i = 0; i < n; ++i )
+        {
+            Client &c = clients[ events[ i ].data.u32 ];
+            const ssize_t res = read( c.fd, buf, sizeof( buf ) );
+            if ( res == 0 || ( res < 0 && errno != EAGAIN && errno != EINTR ) )
+            {
+                std::cerr << "Session " << events[ i ].data.u32 + 1 << " was closed\n";
+                return false;
+            }
+            if ( res > 0 && c.waiting )
+            {
+                std::chrono::duration< double, std::milli > latency = now - c.sent;
+                latencies.push_back( latency.count() );
+                c.waiting = false;
+            }
+            bytes += std::max< ssize_t >( res, 0 );
+        }
+        return true;
+    };
+
+    // The first frames are not timed, they come without a key. Starting is
+    // over once nothing more arrives for a while.
+    int n;
+    while ( ok && ( n = epoll_wait( epoll_fd, events.data(), events.size(), 200 ) ) > 0 )
+    {
+        ok = receive( n, Clock::now() );
+    }
+    bytes = 0;
+    const double start_cpu = cpu_seconds( pid );
+
+    const Clock::time_point begin = Clock::now();
+    const Clock::time_point end = begin + std::chrono::seconds( seconds );
+    for ( int i = 0; i < num_sessions; ++i )
+    {
+        timers.push( { begin + interval * ( rng() % 1000 ) / 1000, i } );
+    }
+
+    while ( ok && Clock::now() < end )
+    {
+        Clock::time_point now = Clock::now();
+        while ( ! timers.empty() && timers.top().when <= now )
+        {
+            Timer t = timers.top();
+            timers.pop();
+            Client &c = clients[ t.client ];
+            if ( c.waiting )
+            {
+                ++late_keys;
+            }
+            else if ( ! send_all( c.fd, key_msgs[ c.right ] ) )
+            {
+                std::cerr << "Session " << t.client + 1 << " was closed\n";
+                ok = false;
+            }
+            else
+            {
+                c.right = ! c.right;
+                c.waiting = true;
+                c.sent = Clock::now();
+                ++keys;
+            }
+            timers.push( { t.when + interval, t.client } );
+        }
+
+        const Clock::time_point next = std::min( end, timers.top().when );
+        // Rounded up, so that waking up early does not cause a busy loop
+        const int timeout_ms = std::chrono::duration_cast< std::chrono::milliseconds >( next - Clock::now() + std::chrono::microseconds( 999 ) ).count();
+
+        n = epoll_wait( epoll_fd, events.data(), events.size(), std::max( timeout_ms, 0 ) );
+        ok = ok && receive( n, Clock::now() );
+    }
+    const double elapsed = std::chrono::duration< double >( Clock::now() - begin ).count();
+    const double server_cpu = cpu_seconds( pid ) - start_cpu;
+
+    for ( Client &c : clients )
+    {
+        close( c.fd );
+    }
+    close( epoll_fd );
+
+    struct rusage res_usage;
+    if ( ! stop_server( res_usage ) )
+    {
+        std::cerr << "Server did not exit cleanly\n";
+        ok = false;
+    }
+    if ( ! ok )
+    {
+        return 1;
+    }
+
+    std::sort( latencies.begin(), latencies.end() );
+    printf( "{\n" );
+    printf( "  \"sessions\": %d,\n", num_sessions );
+    printf( "  \"seconds\": %.6g,\n", elapsed );
+    printf( "  \"keys\": %llu,\n", static_cast< unsigned long long >( keys ) );
+    printf( "  \"late_keys\": %llu,\n", static_cast< unsigned long long >( late_keys ) );
+    printf( "  \"bytes_per_key\": %.6g,\n", keys ? static_cast< double >( bytes ) / keys : 0.0 );
+    printf( "  \"latency_p50_ms\": %.6g,\n", percentile( latencies, 0.5 ) );
+    printf( "  \"latency_p99_ms\": %.6g,\n", percentile( latencies, 0.99 ) );
+    printf( "  \"latency_max_ms\": %.6g,\n", latencies.empty() ? 0.0 : latencies.back() );
+    printf( "  \"server_cpu_seconds\": %.6g,\n", server_cpu );
+    printf( "  \"server_cpu_per_key_us\": %.6g,\n", keys ? server_cpu * 1e6 / keys : 0.0 );
+    printf( "  \"sessions_per_core\": %.6g,\n", server_cpu > 0 ? num_sessions * elapsed / server_cpu : 0.0 );
+    printf( "  \"server_max_rss_kb_per_session\": %.6g\n", static_cast< double >( res_usage.ru_maxrss ) / num_sessions );
+    printf( "}\n" );
+    return 0;
+}
@@ -0,0 +1,203 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "move_scan.h"
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#define FREECELL_SCAN_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Kernels take the sources as 16 bytes: the 8 cascade tops, the 4 cells and
+// 4 zeros, 0 where there is no card. Zero padding lets one SSE register hold
+// them all.
+using Kernel = void (*)( const CardCode *cards, const CardCode *foundations, MoveScan &scan );
+
+void scan_scalar( const CardCode *cards, const CardCode *foundations, MoveScan &scan )
+{
+    scan = MoveScan();
+    for ( int src = 0; src < 12; ++src )
+    {
+        const CardCode c = cards[ src ];
+        if ( ! c )
+        {
+            continue;
+        }
+
+        if ( next_foundation_card[ card_suit( c ) ][ card_rank( foundations[ card_suit( c ) ] ) ] == c )
+        {
+            scan.to_foundation |= 1 << src;
+        }
+        for ( int to = 0; to < 8; ++to )
+        {
+            if ( can_stack( c, cards[ to ] ) )
+            {
+                scan.to_cascade[ to ] |= 1 << src;
+            }
+        }
+    }
+}
+
+#ifdef FREECELL_SCAN_X86
+
+// A card goes on another when the rank is one lower and the color bit
+// differs. No card has rank 0, so nothing goes on an empty cascade; zero
+// sources are masked out separately.
+
+__attribute__(( target( "sse4.1" ) ))
+uint16_t scan_foundations( __m128i cards, __m128i valid, const CardCode *foundations )
+{
+    const __m128i rank_mask = _mm_set1_epi8( 0x0f );
+    uint32_t packed;
+    __builtin_memcpy( &packed, foundations, 4 );
+
+    // Rank on the foundation of each card's suit, looked up by suit index
+    const __m128i foundation_ranks = _mm_and_si128( _mm_cvtsi32_si128( packed ), rank_mask );
+    const __m128i suits = _mm_and_si128( _mm_srli_epi16( cards, 4 ), rank_mask );
+    const __m128i below = _mm_shuffle_epi8( foundation_ranks, suits );
+
+    const __m128i ranks = _mm_and_si128( cards, rank_mask );
+    const __m128i next = _mm_cmpeq_epi8( ranks, _mm_add_epi8( below, _mm_set1_epi8( 1 ) ) );
+    return _mm_movemask_epi8( _mm_and_si128( next, valid ) ) & 0xfff;
+}
+
+__attribute__(( target( "sse4.1" ) ))
+void scan_sse4( const CardCode *cards, const CardCode *foundations, MoveScan &scan )
+{
+    const __m128i src = _mm_loadu_si128( reinterpret_cast< const __m128i* >( cards ) );
+    const __m128i rank_mask = _mm_set1_epi8( 0x0f );
+    const __m128i color = _mm_set1_epi8( 0x20 );
+    const __m128i valid = _mm_xor_si128( _mm_cmpeq_epi8( src, _mm_setzero_si128() ), _mm_set1_epi8( -1 ) );
+    const __m128i wanted_ranks = _mm_add_epi8( _mm_and_si128( src, rank_mask ), _mm_set1_epi8( 1 ) );
+
+    for ( int to = 0; to < 8; ++to )
+    {
+        const __m128i top = _mm_shuffle_epi8( src, _mm_set1_epi8( to ) );
+        const __m128i rank_ok = _mm_cmpeq_epi8( wanted_ranks, _mm_and_si128( top, rank_mask ) );
+        const __m128i color_ok = _mm_cmpeq_epi8( _mm_and_si128( _mm_xor_si128( src, top ), color ), color );
+        scan.to_cascade[ to ] = _mm_movemask_epi8( _mm_and_si128( _mm_and_si128( rank_ok, color_ok ), valid ) ) & 0xfff;
+    }
+    scan.to_foundation = scan_foundations( src, valid, foundations );
+}
+
+// Same as the SSE kernel, with the sources in both halves of the register so
+// that two destinations are checked per step
+__attribute__(( target( "avx2" ) ))
+void scan_avx2( const CardCode *cards, const CardCode *foundations, MoveScan &scan )
+{
+    const __m128i src128 = _mm_loadu_si128( reinterpret_cast< const __m128i* >( cards ) );
+    const __m256i src = _mm256_broadcastsi128_si256( src128 );
+    const __m256i rank_mask = _mm256_set1_epi8( 0x0f );
+    const __m256i color = _mm256_set1_epi8( 0x20 );
+    const __m256i valid = _mm256_xor_si256( _mm256_cmpeq_epi8( src, _mm256_setzero_si256() ), _mm256_set1_epi8( -1 ) );
+    const __m256i wanted_ranks = _mm256_add_epi8( _mm256_and_si256( src, rank_mask ), _mm256_set1_epi8( 1 ) );
+
+    for ( int to = 0; to < 8; to += 2 )
+    {
+        const __m256i index = _mm256_setr_m128i( _mm_set1_epi8( to ), _mm_set1_epi8( to + 1 ) );
+        const __m256i top = _mm256_shuffle_epi8( src, index );
+        const __m256i rank_ok = _mm256_cmpeq_epi8( wanted_ranks, _mm256_and_si256( top, rank_mask ) );
+        const __m256i color_ok = _mm256_cmpeq_epi8( _mm256_and_si256( _mm256_xor_si256( src, top ), color ), color );
+        const uint32_t mask = _mm256_movemask_epi8( _mm256_and_si256( _mm256_and_si256( rank_ok, color_ok ), valid ) );
+        scan.to_cascade[ to ] = mask & 0xfff;
+        scan.to_cascade[ to + 1 ] = mask >> 16 & 0xfff;
+    }
+    scan.to_foundation = scan_foundations( src128, _mm256_castsi256_si128( valid ), foundations );
+}
+
+#endif
+
+constexpr Kernel kernels[] = {
+    scan_scalar,
+#ifdef FREECELL_SCAN_X86
+    scan_sse4,
+    scan_avx2,
+#else
+    scan_scalar,
+    scan_scalar,
+#endif
+};
+
+ScanKernel select_kernel()
+{
+#ifdef FREECELL_SCAN_X86
+    // Runs before main, when the CPU features may not have been read yet
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "avx2" ) )
+    {
+        return ScanKernel::Avx2;
+    }
+    if ( __builtin_cpu_supports( "sse4.1" ) )
+    {
+        return ScanKernel::Sse4;
+    }
+#endif
+    return ScanKernel::Scalar;
+}
+
+const ScanKernel best_kernel = select_kernel();
+const Kernel best_kernel_fn = kernels[ static_cast< int >( best_kernel ) ];
+
+void scan_with( Kernel kernel, const GameState &st, MoveScan &scan )
+{
+    alignas( 16 ) CardCode cards[ 16 ] = {};
+    for ( int i = 0; i < 8; ++i )
+    {
+        const Cascade &cascade = st.cascades[ i ];
+        cards[ i ] = cascade.size ? cascade.m_cards[ cascade.size - 1 ] : 0;
+    }
+    for ( int i = 0; i < 4; ++i )
+    {
+        cards[ 8 + i ] = st.cells[ i ];
+    }
+    kernel( cards, st.foundations.data(), scan );
+}
+
+} // namespace
+
+bool scan_kernel_supported( ScanKernel kernel )
+{
+    return kernel <= best_kernel;
+}
+
+const char* scan_kernel_name( ScanKernel kernel )
+{
+    switch ( kernel )
+    {
+    case ScanKernel::Scalar: return "scalar";
+    case ScanKernel::Sse4:   return "sse4";
+    case ScanKernel::Avx2:   return "avx2";
+    }
+    return "?";
+}
+
+ScanKernel best_scan_kernel()
+{
+    return best_kernel;
+}
+
+void scan_moves( const GameState &st, MoveScan &scan )
+{
+    scan_with( best_kernel_fn, st, scan );
+}
+
+void scan_moves( const GameState &st, MoveScan &scan, ScanKernel kernel )
+{
+    scan_with( kernels[ static_cast< int >( kernel ) ], st, scan );
+}
@@ -0,0 +1,58 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+// Single card moves from every cascade and cell at once.
+//
+// The 12 cards that can be moved are compared against the 8 cascade tops and
+// the foundations together, with SIMD instructions where the CPU has them.
+// The kernel is picked when the program starts.
+
+#include "engine.h"
+
+#include <cstdint>
+
+// Sources are bits of a mask: bit i for the top of cascade i, bit 8 + i for
+// cell i
+struct MoveScan
+{
+    // Sources whose card can be put on the top of each cascade. Empty
+    // cascades take any card, but are left out here.
+    std::array< uint16_t, 8 > to_cascade = {};
+
+    // Sources whose card can go to its foundation
+    uint16_t to_foundation = 0;
+};
+
+enum class ScanKernel : uint8_t
+{
+    Scalar,
+    Sse4,
+    Avx2,
+};
+
+bool scan_kernel_supported( ScanKernel kernel );
+const char* scan_kernel_name( ScanKernel kernel );
+
+// The fastest kernel this CPU can run
+ScanKernel best_scan_kernel();
+
+void scan_moves( const GameState &st, MoveScan &scan );
+
+// With a given kernel, which must be supported
+void scan_moves( const GameState &st, MoveScan &scan, ScanKernel kernel );
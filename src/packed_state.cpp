@@ -0,0 +1,143 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "packed_state.h"
+
+
+namespace {
+
+class BitWriter
+{
+public:
+    explicit BitWriter( uint64_t *words ) : m_words( words ) {}
+
+    void put( uint64_t value, int bits )
+    {
+        int word = m_pos / 64;
+        int offset = m_pos % 64;
+
+        m_words[ word ] |= value << offset;
+        if ( offset + bits > 64 )
+        {
+            m_words[ word + 1 ] |= value >> ( 64 - offset );
+        }
+        m_pos += bits;
+    }
+
+private:
+    uint64_t *m_words;
+    int m_pos = 0;
+};
+
+class BitReader
+{
+public:
+    explicit BitReader( const uint64_t *words ) : m_words( words ) {}
+
+    uint64_t get( int bits )
+    {
+        int word = m_pos / 64;
+        int offset = m_pos % 64;
+
+        uint64_t value = m_words[ word ] >> offset;
+        if ( offset + bits > 64 )
+        {
+            value |= m_words[ word + 1 ] << ( 64 - offset );
+        }
+        m_pos += bits;
+        return value & ( ( uint64_t( 1 ) << bits ) - 1 );
+    }
+
+private:
+    const uint64_t *m_words;
+    int m_pos = 0;
+};
+
+} // namespace
+
+size_t PackedState::hash() const
+{
+    uint64_t h = 0;
+    for ( uint64_t w : m_words )
+    {
+        h = ( h ^ w ) * 0x9E3779B97F4A7C15ull;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+PackedState pack( const GameState &st )
+{
+    PackedState packed;
+    BitWriter out( packed.m_words.data() );
+
+    for ( CardCode c : st.foundations )
+    {
+        out.put( card_rank( c ), 4 );
+    }
+
+    for ( CardCode c : st.cells )
+    {
+        out.put( c, 6 );
+    }
+
+    for ( const Cascade &cascade : st.cascades )
+    {
+        out.put( cascade.size, 5 );
+    }
+
+    for ( const Cascade &cascade : st.cascades )
+    {
+        for ( int i = 0; i < cascade.size; ++i )
+        {
+            out.put( cascade.m_cards[ i ], 6 );
+        }
+    }
+
+    return packed;
+}
+
+void unpack( const PackedState &packed, GameState &st )
+{
+    BitReader in( packed.m_words.data() );
+
+    for ( int i = 0; i < 4; ++i )
+    {
+        int rank = in.get( 4 );
+        st.foundations[ i ] = ( rank ? make_card( i, rank ) : 0 );
+    }
+
+    for ( CardCode &c : st.cells )
+    {
+        c = in.get( 6 );
+    }
+
+    for ( Cascade &cascade : st.cascades )
+    {
+        cascade.size = in.get( 5 );
+    }
+
+    for ( Cascade &cascade : st.cascades )
+    {
+        for ( int i = 0; i < cascade.size; ++i )
+        {
+            cascade.m_cards[ i ] = in.get( 6 );
+        }
+    }
+
+    update_derived( st );
+}
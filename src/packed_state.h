@@ -0,0 +1,70 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+// Compact form of GameState for storing large numbers of positions.
+//
+// Bit layout, from the least significant bit of the first word:
+//   - foundations: 4 x 4 bit rank of the top card (0 for empty)
+//   - cells: 4 x 6 bit card code
+//   - cascade sizes: 8 x 5 bit
+//   - cascade cards: 6 bit card code for each card, cascade by cascade,
+//     from the bottom of the pile
+//
+// At most 52 cards are in cascades, so this needs 392 bits.
+
+#include "engine.h"
+
+#include <array>
+#include <cstdint>
+#include <functional>
+
+struct PackedState
+{
+    std::array< uint64_t, 7 > m_words = {};
+
+    bool operator==( const PackedState &ot ) const
+    {
+        return m_words == ot.m_words;
+    }
+
+    bool operator!=( const PackedState &ot ) const
+    {
+        return m_words != ot.m_words;
+    }
+
+    size_t hash() const;
+};
+
+static_assert( sizeof( PackedState ) < 64, "PackedState should fit in a cache line" );
+
+PackedState pack( const GameState &st );
+void unpack( const PackedState &packed, GameState &st );
+
+namespace std {
+
+template <>
+struct hash< PackedState >
+{
+    size_t operator()( const PackedState &p ) const
+    {
+        return p.hash();
+    }
+};
+
+} // namespace std
@@ -0,0 +1,318 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "parallel_solver.h"
+
+#include <algorithm>
+#include <new>
+#include <thread>
+
+#include <sys/mman.h>
+
+namespace {
+
+// Workers take node indices in blocks, so that the shared counter is not
+// touched for every position
+const uint32_t node_block = 256;
+
+// Most entries moved from another worker's frontier at once
+const size_t max_steal = 64;
+
+// Same as in Solver
+const int depth_weight = 1;
+
+} // namespace
+
+ParallelSolver::ParallelSolver( const SolverOptions &opts )
+    : m_opts( opts )
+    , m_threads( std::max( 1, opts.threads ) )
+    , m_seen( opts.max_positions * 2 )
+    , m_frontiers( m_threads )
+{
+    m_nodes_bytes = std::max< size_t >( m_opts.max_positions, 1 ) * sizeof( Node );
+    void *mem = mmap( nullptr, m_nodes_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if ( mem == MAP_FAILED )
+    {
+        throw std::bad_alloc();
+    }
+    m_nodes = static_cast< Node* >( mem );
+}
+
+ParallelSolver::~ParallelSolver()
+{
+    munmap( m_nodes, m_nodes_bytes );
+}
+
+uint32_t ParallelSolver::new_node( uint32_t &next, uint32_t &end )
+{
+    if ( next == end )
+    {
+        uint32_t begin = m_num_nodes.fetch_add( node_block, std::memory_order_relaxed );
+        if ( begin >= m_opts.max_positions )
+        {
+            return m_opts.max_positions;
+        }
+        next = begin;
+        end = std::min< size_t >( begin + node_block, m_opts.max_positions );
+    }
+    return next++;
+}
+
+bool ParallelSolver::pop( int self, QueueEntry &entry )
+{
+    Frontier &f = m_frontiers[ self ];
+    if ( f.size.load( std::memory_order_relaxed ) == 0 )
+    {
+        return false;
+    }
+
+    std::lock_guard< std::mutex > guard( f.lock );
+    if ( f.heap.empty() )
+    {
+        return false;
+    }
+
+    std::pop_heap( f.heap.begin(), f.heap.end() );
+    entry = f.heap.back();
+    f.heap.pop_back();
+    f.size.store( f.heap.size(), std::memory_order_relaxed );
+    return true;
+}
+
+void ParallelSolver::push( int self, const QueueEntry *entries, size_t count )
+{
+    Frontier &f = m_frontiers[ self ];
+    std::lock_guard< std::mutex > guard( f.lock );
+    for ( size_t i = 0; i < count; ++i )
+    {
+        f.heap.push_back( entries[ i ] );
+        std::push_heap( f.heap.begin(), f.heap.end() );
+    }
+    f.size.store( f.heap.size(), std::memory_order_relaxed );
+}
+
+bool ParallelSolver::steal( int self, QueueEntry &entry )
+{
+    QueueEntry stolen[ max_steal ];
+    size_t count = 0;
+
+    for ( int i = 1; i < m_threads && count == 0; ++i )
+    {
+        Frontier &victim = m_frontiers[ ( self + i ) % m_threads ];
+        if ( victim.size.load( std::memory_order_relaxed ) == 0 )
+        {
+            continue;
+        }
+
+        // The best entries, so that the search stays close to best-first
+        std::lock_guard< std::mutex > guard( victim.lock );
+        size_t n = std::min( max_steal, ( victim.heap.size() + 1 ) / 2 );
+        for ( ; count < n; ++count )
+        {
+            std::pop_heap( victim.heap.begin(), victim.heap.end() );
+            stolen[ count ] = victim.heap.back();
+            victim.heap.pop_back();
+        }
+        victim.size.store( victim.heap.size(), std::memory_order_relaxed );
+    }
+
+    if ( count == 0 )
+    {
+        return false;
+    }
+
+    entry = stolen[ 0 ];
+    push( self, stolen + 1, count - 1 );
+    return true;
+}
+
+void ParallelSolver::work( int self, uint64_t &expanded, uint64_t &generated )
+{
+    GameState st;
+    MoveList moves;
+    MoveList forced;
+    std::vector< QueueEntry > children;
+    uint32_t next_node = 0;
+    uint32_t end_node = 0;
+
+    while ( ! m_done.load( std::memory_order_acquire ) )
+    {
+        QueueEntry entry;
+        if ( ! pop( self, entry ) && ! steal( self, entry ) )
+        {
+            // Only workers expanding a position add to the frontiers, so when
+            // every worker is idle the search is over
+            if ( m_idle.fetch_add( 1 ) + 1 == m_threads )
+            {
+                m_done.store( true, std::memory_order_release );
+                return;
+            }
+
+            bool found_work = false;
+            while ( ! found_work && ! m_done.load( std::memory_order_acquire ) )
+            {
+                for ( const Frontier &f : m_frontiers )
+                {
+                    found_work |= f.size.load( std::memory_order_relaxed ) > 0;
+                }
+
+                if ( ! found_work )
+                {
+                    if ( m_idle.load() == m_threads )
+                    {
+                        m_done.store( true, std::memory_order_release );
+                    }
+                    std::this_thread::yield();
+                }
+            }
+
+            m_idle.fetch_sub( 1 );
+            continue;
+        }
+
+        if ( m_opts.cancel && m_opts.cancel->load( std::memory_order_relaxed ) )
+        {
+            m_limit_reached.store( true, std::memory_order_relaxed );
+            m_done.store( true, std::memory_order_release );
+            return;
+        }
+
+        const Node &cur = m_nodes[ entry.node ];
+        unpack( cur.state, st );
+        ++expanded;
+
+        children.clear();
+        generate_moves( st, moves );
+        for ( const Move &m : moves )
+        {
+            apply_move( st, m );
+            forced.size = 0;
+            auto_play( st, forced );
+
+            if ( m_seen.insert( st.hash, entry.node ) != TranspositionTable::InsertResult::Present )
+            {
+                uint32_t idx = new_node( next_node, end_node );
+                if ( idx == m_opts.max_positions )
+                {
+                    m_limit_reached.store( true, std::memory_order_relaxed );
+                    m_done.store( true, std::memory_order_release );
+                    return;
+                }
+
+                ++generated;
+                Node &child = m_nodes[ idx ];
+                child.state = pack( st );
+                child.parent = entry.node;
+                child.depth = cur.depth + 1;
+                child.move = m;
+
+                if ( is_full_foundations( st ) )
+                {
+                    int64_t none = -1;
+                    m_solved_node.compare_exchange_strong( none, idx );
+                    m_done.store( true, std::memory_order_release );
+                    return;
+                }
+
+                children.push_back( { heuristic( st ) + child.depth * depth_weight, idx } );
+            }
+
+            for ( int i = forced.size - 1; i >= 0; --i )
+            {
+                undo_move( st, forced.m_moves[ i ] );
+            }
+            undo_move( st, m );
+        }
+
+        push( self, children.data(), children.size() );
+    }
+}
+
+SolveResult ParallelSolver::solve( const GameState &start )
+{
+    SolveResult res;
+
+    if ( m_seen_used )
+    {
+        m_seen.clear();
+    }
+    m_seen_used = true;
+
+    for ( Frontier &f : m_frontiers )
+    {
+        f.heap.clear();
+        f.size.store( 0 );
+    }
+    m_done.store( false );
+    m_idle.store( 0 );
+    m_limit_reached.store( false );
+    m_solved_node.store( -1 );
+
+    // Searched after auto play, as in Solver
+    GameState root = start;
+    MoveList forced;
+    auto_play( root, forced );
+
+    m_nodes[ 0 ] = { pack( root ), 0, 0, Move() };
+    m_num_nodes.store( 1 );
+    m_seen.insert( root.hash, 0 );
+    m_frontiers[ 0 ].heap.push_back( { heuristic( root ), 0 } );
+    m_frontiers[ 0 ].size.store( 1 );
+
+    std::vector< uint64_t > expanded( m_threads );
+    std::vector< uint64_t > generated( m_threads );
+    std::vector< std::thread > workers;
+    for ( int i = 1; i < m_threads; ++i )
+    {
+        workers.emplace_back( [ this, i, &expanded, &generated ] { work( i, expanded[ i ], generated[ i ] ); } );
+    }
+    work( 0, expanded[ 0 ], generated[ 0 ] );
+    for ( std::thread &t : workers )
+    {
+        t.join();
+    }
+
+    res.generated = 1;
+    for ( int i = 0; i < m_threads; ++i )
+    {
+        res.expanded += expanded[ i ];
+        res.generated += generated[ i ];
+    }
+
+    int64_t solved_node = m_solved_node.load();
+    if ( solved_node >= 0 )
+    {
+        res.status = SolveStatus::Solved;
+        for ( uint32_t idx = solved_node; idx != 0; idx = m_nodes[ idx ].parent )
+        {
+            res.moves.push_back( m_nodes[ idx ].move );
+        }
+        std::reverse( res.moves.begin(), res.moves.end() );
+        res.moves = with_auto_play( start, res.moves );
+    }
+    else if ( is_full_foundations( root ) )
+    {
+        res.status = SolveStatus::Solved;
+        res.moves = with_auto_play( start, res.moves );
+    }
+    else if ( ! m_limit_reached.load() )
+    {
+        res.status = SolveStatus::Unsolvable;
+    }
+
+    return res;
+}
@@ -0,0 +1,102 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "engine.h"
+#include "packed_state.h"
+#include "solver.h"
+#include "transposition_table.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Best-first search like Solver, with several threads expanding positions at
+// once. Each worker has its own frontier, and takes the best half of another
+// worker's frontier when its own runs out. Positions are shared through a
+// single transposition table, so each is expanded only once.
+//
+// The order in which positions are expanded depends on timing, so solutions
+// found may differ from run to run, and from the ones of Solver.
+class ParallelSolver
+{
+public:
+    explicit ParallelSolver( const SolverOptions &opts );
+    ~ParallelSolver();
+
+    ParallelSolver( const ParallelSolver& ) = delete;
+    ParallelSolver& operator=( const ParallelSolver& ) = delete;
+
+    SolveResult solve( const GameState &start );
+
+private:
+    struct Node
+    {
+        PackedState state;
+        uint32_t parent;
+        uint16_t depth;
+        Move move;
+    };
+
+    struct QueueEntry
+    {
+        int priority;
+        uint32_t node;
+
+        bool operator<( const QueueEntry &ot ) const
+        {
+            // Lowest priority first, newest first among equals
+            return priority != ot.priority ? priority > ot.priority : node < ot.node;
+        }
+    };
+
+    struct alignas( 64 ) Frontier
+    {
+        std::mutex lock;
+        std::vector< QueueEntry > heap;
+        std::atomic< size_t > size{ 0 }; // Readable without taking the lock
+    };
+
+    void work( int self, uint64_t &expanded, uint64_t &generated );
+
+    bool pop( int self, QueueEntry &entry );
+    bool steal( int self, QueueEntry &entry );
+    void push( int self, const QueueEntry *entries, size_t count );
+
+    // Returns max_positions if the limit is reached
+    uint32_t new_node( uint32_t &next, uint32_t &end );
+
+    SolverOptions m_opts;
+    int m_threads;
+
+    // Fixed size, allocated with mmap so untouched pages cost nothing
+    Node *m_nodes;
+    size_t m_nodes_bytes;
+    std::atomic< uint32_t > m_num_nodes{ 0 };
+
+    TranspositionTable m_seen;
+    bool m_seen_used = false; // Fresh from mmap, so the first search need not clear it
+    std::vector< Frontier > m_frontiers;
+
+    std::atomic< bool > m_done{ false };
+    std::atomic< int > m_idle{ 0 };
+    std::atomic< bool > m_limit_reached{ false };
+    std::atomic< int64_t > m_solved_node{ -1 };
+};
@@ -0,0 +1,98 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Objects of one type, carved out of chunks of chunk_size and reused through
+// a free list. Chunks are only released with the pool, so creating and
+// destroying objects does not allocate once the pool has grown to the peak
+// number of them, and freed slots are reused while still in cache.
+//
+// Objects must all be destroyed before the pool is.
+template < typename T, size_t chunk_size = 256 >
+class Pool
+{
+public:
+    Pool() = default;
+    Pool( const Pool& ) = delete;
+    Pool& operator=( const Pool& ) = delete;
+
+    ~Pool()
+    {
+        for ( Slot *chunk : m_chunks )
+        {
+            ::operator delete( chunk );
+        }
+    }
+
+    template < typename... Args >
+    T* create( Args&&... args )
+    {
+        if ( ! m_free )
+        {
+            grow();
+        }
+
+        Slot *slot = m_free;
+        m_free = slot->next;
+        ++m_size;
+        return new ( slot->storage ) T( std::forward< Args >( args )... );
+    }
+
+    void destroy( T *obj )
+    {
+        obj->~T();
+        Slot *slot = reinterpret_cast< Slot* >( obj );
+        slot->next = m_free;
+        m_free = slot;
+        --m_size;
+    }
+
+    // Objects alive
+    size_t size() const { return m_size; }
+
+    size_t capacity() const { return m_chunks.size() * chunk_size; }
+
+private:
+    union Slot
+    {
+        Slot *next; // While free
+        alignas( T ) unsigned char storage[ sizeof( T ) ];
+    };
+
+    void grow()
+    {
+        Slot *chunk = static_cast< Slot* >( ::operator new( chunk_size * sizeof( Slot ) ) );
+        m_chunks.push_back( chunk );
+
+        // Lowest addresses first
+        for ( size_t i = chunk_size; i-- > 0; )
+        {
+            chunk[ i ].next = m_free;
+            m_free = &chunk[ i ];
+        }
+    }
+
+    std::vector< Slot* > m_chunks;
+    Slot *m_free = nullptr;
+    size_t m_size = 0;
+};
@@ -0,0 +1,74 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+// What a client (freecell --connect) and the game server (freecell --serve)
+// send each other over a Unix domain stream socket, in native byte order.
+//
+// The client sends messages, each a ClientHeader followed by size bytes of
+// payload, starting with exactly one Start. The server sends back what the
+// terminal should show, as is, and closes the connection when the game is
+// over.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+enum class ClientMessage : uint8_t
+{
+    Start,  // StartPayload
+    Input,  // Bytes read from the terminal
+    Resize, // ResizePayload
+};
+
+struct ClientHeader
+{
+    ClientMessage type;
+    uint8_t reserved;
+    uint16_t size;
+};
+
+struct StartPayload
+{
+    uint64_t seed;   // 0 for a random one
+    uint8_t ms_deal; // Whether seed is a Microsoft deal number
+    uint8_t reserved;
+    uint16_t rows;
+    uint16_t cols;
+    uint16_t reserved2;
+};
+
+struct ResizePayload
+{
+    uint16_t rows;
+    uint16_t cols;
+};
+
+const size_t max_payload_size = 4096;
+
+// Largest terminal the server draws for, a session asking for more is closed
+const uint16_t max_term_rows = 500;
+const uint16_t max_term_cols = 500;
+
+// Appends a message to buf, size must be at most max_payload_size
+inline void append_message( std::string &buf, ClientMessage type, const void *payload, size_t size )
+{
+    ClientHeader header = { type, 0, static_cast< uint16_t >( size ) };
+    buf.append( reinterpret_cast< const char* >( &header ), sizeof( header ) );
+    buf.append( static_cast< const char* >( payload ), size );
+}
@@ -0,0 +1,161 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "saved_game.h"
+
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char save_magic[ 8 ] = { 'F', 'C', 'S', 'A', 'V', 'E', '\0', '\0' };
+
+uint64_t fnv1a( const void *data, size_t size, uint64_t h = 14695981039346656037ull )
+{
+    const uint8_t *p = static_cast< const uint8_t* >( data );
+    for ( size_t i = 0; i < size; ++i )
+    {
+        h = ( h ^ p[ i ] ) * 1099511628211ull;
+    }
+    return h;
+}
+
+// Checksum of a file starting with header, whose checksum field is skipped
+uint64_t checksum( const SaveHeader &header, const void *rest, size_t rest_size )
+{
+    SaveHeader copy = header;
+    copy.checksum = 0;
+    return fnv1a( rest, rest_size, fnv1a( &copy, sizeof( copy ) ) );
+}
+
+size_t save_size( uint64_t num_moves, uint64_t num_snapshots )
+{
+    return sizeof( SaveHeader ) + num_snapshots * sizeof( PackedState ) + num_moves * sizeof( uint16_t );
+}
+
+bool write_all( int fd, const void *data, size_t size )
+{
+    const char *p = static_cast< const char* >( data );
+    while ( size > 0 )
+    {
+        ssize_t res = write( fd, p, size );
+        if ( res < 0 )
+        {
+            if ( errno == EINTR )
+            {
+                continue;
+            }
+            return false;
+        }
+        p += res;
+        size -= res;
+    }
+    return true;
+}
+
+} // namespace
+
+bool save_game( const std::string &path, uint64_t seed, bool ms_deal, const GameState &st, const History &history )
+{
+    const std::vector< uint16_t > &moves = history.raw_moves();
+    const std::vector< PackedState > &snapshots = history.raw_snapshots();
+
+    // Header last, once the checksum of the rest is known
+    std::vector< char > buf( save_size( moves.size(), snapshots.size() ) );
+    char *rest = buf.data() + sizeof( SaveHeader );
+    memcpy( rest, snapshots.data(), snapshots.size() * sizeof( PackedState ) );
+    memcpy( rest + snapshots.size() * sizeof( PackedState ), moves.data(), moves.size() * sizeof( uint16_t ) );
+
+    SaveHeader header = {};
+    memcpy( header.magic, save_magic, sizeof( header.magic ) );
+    header.version = save_version;
+    header.ms_deal = ms_deal;
+    header.seed = seed;
+    header.num_moves = moves.size();
+    header.position = history.position();
+    header.num_snapshots = snapshots.size();
+    header.current = pack( st );
+    header.checksum = checksum( header, rest, buf.size() - sizeof( SaveHeader ) );
+    memcpy( buf.data(), &header, sizeof( header ) );
+
+    const std::string tmp_path = path + ".tmp";
+    int fd = open( tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+    if ( fd < 0 )
+    {
+        return false;
+    }
+    bool ok = write_all( fd, buf.data(), buf.size() ) && fsync( fd ) == 0;
+    ok = ( close( fd ) == 0 ) && ok;
+    if ( ! ok || rename( tmp_path.c_str(), path.c_str() ) != 0 )
+    {
+        unlink( tmp_path.c_str() );
+        return false;
+    }
+    return true;
+}
+
+bool load_game( const std::string &path, uint64_t &seed, bool &ms_deal, GameState &st, History &history )
+{
+    int fd = open( path.c_str(), O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 )
+    {
+        return false;
+    }
+
+    struct stat info;
+    if ( fstat( fd, &info ) != 0 || static_cast< size_t >( info.st_size ) < sizeof( SaveHeader ) )
+    {
+        close( fd );
+        return false;
+    }
+
+    const size_t size = info.st_size;
+    void *data = mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if ( data == MAP_FAILED )
+    {
+        return false;
+    }
+
+    const SaveHeader &header = *static_cast< const SaveHeader* >( data );
+    const char *rest = static_cast< const char* >( data ) + sizeof( SaveHeader );
+    const PackedState *snapshots = reinterpret_cast< const PackedState* >( rest );
+
+    bool ok = memcmp( header.magic, save_magic, sizeof( header.magic ) ) == 0
+           && header.version == save_version
+           && header.num_moves <= size && header.num_snapshots <= size
+           && save_size( header.num_moves, header.num_snapshots ) == size
+           && checksum( header, rest, size - sizeof( SaveHeader ) ) == header.checksum;
+
+    ok = ok && history.restore( reinterpret_cast< const uint16_t* >( snapshots + header.num_snapshots ), header.num_moves,
+                                snapshots, header.num_snapshots, header.position );
+    if ( ok )
+    {
+        seed = header.seed;
+        ms_deal = header.ms_deal;
+        unpack( header.current, st );
+    }
+
+    munmap( data, size );
+    return ok;
+}
@@ -0,0 +1,60 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+// A game in progress, saved so that it can be resumed where it was left.
+//
+// Layout, in native byte order:
+//   - SaveHeader, with the current position
+//   - the snapshots of the history
+//   - the moves of the history, including the ones that can be redone
+//
+// Everything is stored as the game holds it, so loading is copying the
+// arrays out of the mapped file rather than replaying the moves.
+
+#include "engine.h"
+#include "history.h"
+#include "packed_state.h"
+
+#include <cstdint>
+#include <string>
+
+const uint32_t save_version = 1;
+
+struct SaveHeader
+{
+    char magic[ 8 ];
+    uint32_t version;
+    uint32_t ms_deal;
+    uint64_t seed;
+    uint64_t num_moves;
+    uint64_t position;
+    uint64_t num_snapshots;
+    uint64_t checksum; // FNV-1a of the whole file, taken with this field zero
+    PackedState current;
+};
+
+static_assert( sizeof( SaveHeader ) == 112, "Save header layout changed" );
+
+// Writes the game to a temporary file that is then renamed over path, so a
+// crash while saving leaves the previous save. Returns false on error.
+bool save_game( const std::string &path, uint64_t seed, bool ms_deal, const GameState &st, const History &history );
+
+// Returns false, changing nothing, if the file is missing, damaged, or saved
+// by another version
+bool load_game( const std::string &path, uint64_t &seed, bool &ms_deal, GameState &st, History &history );
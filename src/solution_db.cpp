@@ -0,0 +1,119 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "solution_db.h"
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char solution_db_magic[ 8 ] = { 'F', 'C', 'S', 'O', 'L', 'D', 'B', '1' };
+
+size_t solution_db_size( uint64_t num_deals, uint64_t num_moves )
+{
+    return sizeof( SolutionDbHeader ) + num_deals * sizeof( SolutionDbEntry ) + num_moves * sizeof( uint16_t );
+}
+
+SolutionDb::~SolutionDb()
+{
+    close();
+}
+
+bool SolutionDb::open( const std::string &path )
+{
+    close();
+
+    int fd = ::open( path.c_str(), O_RDONLY );
+    if ( fd < 0 )
+    {
+        return false;
+    }
+
+    struct stat st;
+    if ( fstat( fd, &st ) != 0 || static_cast< size_t >( st.st_size ) < sizeof( SolutionDbHeader ) )
+    {
+        ::close( fd );
+        return false;
+    }
+
+    void *data = mmap( nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    ::close( fd );
+    if ( data == MAP_FAILED )
+    {
+        return false;
+    }
+
+    const SolutionDbHeader *header = static_cast< const SolutionDbHeader* >( data );
+    const bool ok = memcmp( header->magic, solution_db_magic, sizeof( header->magic ) ) == 0
+                 && header->num_deals <= st.st_size / sizeof( SolutionDbEntry )
+                 && header->num_moves <= st.st_size / sizeof( uint16_t )
+                 && solution_db_size( header->num_deals, header->num_moves ) == static_cast< size_t >( st.st_size );
+    if ( ! ok )
+    {
+        munmap( data, st.st_size );
+        return false;
+    }
+
+    m_data = data;
+    m_size = st.st_size;
+    m_header = header;
+    m_entries = reinterpret_cast< const SolutionDbEntry* >( header + 1 );
+    m_moves = reinterpret_cast< const uint16_t* >( m_entries + header->num_deals );
+    return true;
+}
+
+void SolutionDb::close()
+{
+    if ( m_data )
+    {
+        munmap( m_data, m_size );
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_header = nullptr;
+    m_entries = nullptr;
+    m_moves = nullptr;
+}
+
+SolutionDb::Result SolutionDb::lookup( uint64_t deal, bool ms_deal ) const
+{
+    Result res;
+    if ( ! m_data || ms_deal != static_cast< bool >( m_header->ms_deals )
+      || deal < m_header->first_deal || deal - m_header->first_deal >= m_header->num_deals )
+    {
+        return res;
+    }
+
+    const SolutionDbEntry &e = m_entries[ deal - m_header->first_deal ];
+    if ( e.status > DealStatus::Unsolvable
+      || ( e.status == DealStatus::Solvable && e.first_move + static_cast< uint64_t >( e.num_moves ) > m_header->num_moves ) )
+    {
+        return res;
+    }
+
+    res.status = e.status;
+    res.difficulty = e.difficulty;
+    if ( e.status == DealStatus::Solvable )
+    {
+        res.moves = m_moves + e.first_move;
+        res.num_moves = e.num_moves;
+    }
+    return res;
+}
@@ -0,0 +1,110 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+// Precomputed results for a range of deals, in a file that is mapped into
+// memory and read in place.
+//
+// Layout, in native byte order:
+//   - SolutionDbHeader
+//   - one SolutionDbEntry per deal, in deal order from first_deal
+//   - the moves of all solutions, as encoded by encode_move(), each
+//     solution starting from the deal and including auto played moves
+//
+// Looking up a deal is indexing the entries, so opening a file of millions
+// of deals costs the same as opening one of a few.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+enum class DealStatus : uint8_t
+{
+    Unknown, // Not analyzed, or the solver gave up
+    Solvable,
+    Unsolvable,
+};
+
+struct SolutionDbHeader
+{
+    char magic[ 8 ];
+    uint64_t first_deal;
+    uint64_t num_deals;
+    uint64_t num_moves; // Size of the move stream
+    uint32_t ms_deals;  // Whether deals are Microsoft deal numbers rather than seeds
+    uint32_t reserved;
+};
+
+static_assert( sizeof( SolutionDbHeader ) == 40, "Solution database header layout changed" );
+
+struct SolutionDbEntry
+{
+    uint32_t first_move; // Index into the move stream
+    uint16_t num_moves;
+    DealStatus status;
+
+    // Bit length of the number of positions the solver expanded, so each
+    // step up is roughly twice as hard
+    uint8_t difficulty;
+};
+
+static_assert( sizeof( SolutionDbEntry ) == 8, "Solution database entry layout changed" );
+
+extern const char solution_db_magic[ 8 ];
+
+// Size of a file with given contents
+size_t solution_db_size( uint64_t num_deals, uint64_t num_moves );
+
+class SolutionDb
+{
+public:
+    struct Result
+    {
+        DealStatus status = DealStatus::Unknown;
+        uint8_t difficulty = 0;
+        const uint16_t *moves = nullptr; // Solution, if solvable
+        size_t num_moves = 0;
+    };
+
+    SolutionDb() = default;
+    SolutionDb( const SolutionDb& ) = delete;
+    SolutionDb& operator=( const SolutionDb& ) = delete;
+    ~SolutionDb();
+
+    // Maps the file, checking only its header and size. Returns false if it
+    // cannot be read or is not a solution database, leaving this closed.
+    bool open( const std::string &path );
+    void close();
+
+    bool is_open() const { return m_data != nullptr; }
+
+    const SolutionDbHeader& header() const { return *m_header; }
+
+    // Unknown for deals outside the file, or of the other kind of deal.
+    // Solutions reaching past the move stream are treated as unknown too,
+    // so a damaged file gives no results rather than reading out of bounds.
+    Result lookup( uint64_t deal, bool ms_deal ) const;
+
+private:
+    void *m_data = nullptr;
+    size_t m_size = 0;
+
+    const SolutionDbHeader *m_header = nullptr;
+    const SolutionDbEntry *m_entries = nullptr;
+    const uint16_t *m_moves = nullptr;
+};
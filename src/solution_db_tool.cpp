@@ -0,0 +1,381 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+// Builds a solution database (see solution_db.h) from the output of
+// "freecell --analyze-range ... --moves", and checks that every solution in
+// it wins its deal.
+
+#include "deal.h"
+#include "engine.h"
+#include "game_log.h"
+#include "history.h"
+#include "solution_db.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+const char usage[] = R"(
+usage: freecell_db ANALYSIS OUTPUT [--ms-deals] [--threads N]
+       freecell_db --verify DB [--threads N]
+
+  Builds OUTPUT from ANALYSIS, the output of freecell --analyze-range with
+  --moves, then verifies it. Deals missing from the analysis are stored as
+  unknown.
+
+  --verify    only check that every solution in DB wins its deal, exits with
+              status 2 if one does not
+  --ms-deals  the analysis is of Microsoft deal numbers
+  --threads   number of threads verifying (all cores by default)
+)";
+
+// One line of analysis
+struct AnalysisLine
+{
+    uint64_t deal = 0;
+    DealStatus status = DealStatus::Unknown;
+    uint32_t num_moves = 0;
+    uint64_t expanded = 0;
+    std::string_view moves; // Hex digits, 4 per move
+};
+
+bool parse_line( const std::string &line, AnalysisLine &res )
+{
+    char status[ 16 ];
+    uint64_t micros;
+    int consumed = 0;
+    if ( sscanf( line.c_str(), "%" SCNu64 " %15s %" SCNu32 " %" SCNu64 " %" SCNu64 "%n",
+                 &res.deal, status, &res.num_moves, &res.expanded, &micros, &consumed ) != 5 )
+    {
+        return false;
+    }
+
+    std::string_view rest( line );
+    rest.remove_prefix( consumed );
+    res.moves = rest.empty() ? rest : rest.substr( 1 );
+
+    if ( strcmp( status, "solved" ) == 0 )
+    {
+        res.status = DealStatus::Solvable;
+        return rest.size() > 1 && rest[ 0 ] == ' '
+            && res.num_moves <= UINT16_MAX
+            && res.moves.size() == 4 * res.num_moves
+            && std::all_of( res.moves.begin(), res.moves.end(), ::isxdigit );
+    }
+
+    res.status = ( strcmp( status, "unsolvable" ) == 0 ? DealStatus::Unsolvable : DealStatus::Unknown );
+    return rest.empty() && ( res.status == DealStatus::Unsolvable || strcmp( status, "unknown" ) == 0 );
+}
+
+uint8_t difficulty( uint64_t expanded )
+{
+    return expanded ? 64 - __builtin_clzll( expanded ) : 0;
+}
+
+uint16_t parse_hex( std::string_view s )
+{
+    uint16_t val = 0;
+    for ( char c : s )
+    {
+        val = val << 4 | ( c <= '9' ? c - '0' : ( c | 0x20 ) - 'a' + 10 );
+    }
+    return val;
+}
+
+// Calls f for each line of the file, stopping at the first one it returns
+// false for. Returns false on error, printing it.
+template < typename F >
+bool for_each_line( const std::string &path, F f )
+{
+    std::ifstream in( path );
+    if ( ! in )
+    {
+        std::cerr << "Cannot read " << path << "\n";
+        return false;
+    }
+
+    std::string line;
+    uint64_t line_num = 0;
+    while ( std::getline( in, line ) )
+    {
+        ++line_num;
+        AnalysisLine parsed;
+        if ( ! parse_line( line, parsed ) )
+        {
+            std::cerr << path << ":" << line_num << ": invalid line"
+                      << ( line.find( " solved " ) != std::string::npos ? ", analyze with --moves" : "" ) << "\n";
+            return false;
+        }
+        if ( ! f( parsed ) )
+        {
+            std::cerr << path << ":" << line_num << ": deal " << parsed.deal << " is listed twice\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+int build( const std::string &analysis_path, const std::string &path, bool ms_deals )
+{
+    // First pass for the size of the file, second to fill it in
+    uint64_t first = UINT64_MAX, last = 0, num_moves = 0;
+    bool ok = for_each_line( analysis_path, [ & ]( const AnalysisLine &line )
+    {
+        first = std::min( first, line.deal );
+        last = std::max( last, line.deal );
+        num_moves += line.num_moves * ( line.status == DealStatus::Solvable );
+        return true;
+    } );
+    if ( ! ok )
+    {
+        return 1;
+    }
+    if ( first > last )
+    {
+        std::cerr << analysis_path << " is empty\n";
+        return 1;
+    }
+    if ( num_moves > UINT32_MAX )
+    {
+        std::cerr << "Too many moves for one file, split the range\n";
+        return 1;
+    }
+
+    const uint64_t num_deals = last - first + 1;
+    const size_t size = solution_db_size( num_deals, num_moves );
+    const std::string tmp_path = path + ".tmp";
+    int fd = open( tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+    if ( fd < 0 || ftruncate( fd, size ) != 0 )
+    {
+        std::cerr << "Cannot create " << tmp_path << "\n";
+        return 1;
+    }
+    void *data = mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    if ( data == MAP_FAILED )
+    {
+        std::cerr << "Cannot map " << tmp_path << "\n";
+        close( fd );
+        return 1;
+    }
+
+    SolutionDbHeader *header = static_cast< SolutionDbHeader* >( data );
+    memcpy( header->magic, solution_db_magic, sizeof( header->magic ) );
+    header->first_deal = first;
+    header->num_deals = num_deals;
+    header->num_moves = num_moves;
+    header->ms_deals = ms_deals;
+
+    // The file starts zeroed, which is an unknown deal
+    SolutionDbEntry *entries = reinterpret_cast< SolutionDbEntry* >( header + 1 );
+    uint16_t *moves = reinterpret_cast< uint16_t* >( entries + num_deals );
+    std::vector< bool > seen( num_deals );
+    uint32_t next_move = 0;
+    ok = for_each_line( analysis_path, [ & ]( const AnalysisLine &line )
+    {
+        const uint64_t idx = line.deal - first;
+        if ( seen[ idx ] )
+        {
+            return false;
+        }
+        seen[ idx ] = true;
+
+        SolutionDbEntry &e = entries[ idx ];
+        e.status = line.status;
+        e.difficulty = difficulty( line.expanded );
+        if ( line.status == DealStatus::Solvable )
+        {
+            e.first_move = next_move;
+            e.num_moves = line.num_moves;
+            for ( uint32_t i = 0; i < line.num_moves; ++i )
+            {
+                moves[ next_move++ ] = parse_hex( line.moves.substr( 4 * i, 4 ) );
+            }
+        }
+        return true;
+    } );
+
+    ok = ok && munmap( data, size ) == 0 && fsync( fd ) == 0;
+    ok = ( close( fd ) == 0 ) && ok;
+    if ( ! ok || rename( tmp_path.c_str(), path.c_str() ) != 0 )
+    {
+        std::cerr << "Cannot write " << path << "\n";
+        unlink( tmp_path.c_str() );
+        return 1;
+    }
+    return 0;
+}
+
+int verify( const std::string &path, int num_threads )
+{
+    SolutionDb db;
+    if ( ! db.open( path ) )
+    {
+        std::cerr << "Cannot read solution database " << path << "\n";
+        return 1;
+    }
+
+    const SolutionDbHeader &header = db.header();
+    const bool ms_deals = header.ms_deals;
+    std::atomic< uint64_t > counts[ 3 ] = {};
+    std::atomic< uint64_t > failed{ 0 };
+
+    auto worker = [ & ]( int self )
+    {
+        GameState st;
+        History hist;
+        uint64_t local_counts[ 3 ] = {};
+
+        const uint64_t begin = header.num_deals * self / num_threads;
+        const uint64_t end = header.num_deals * ( self + 1 ) / num_threads;
+        for ( uint64_t i = begin; i < end; ++i )
+        {
+            const uint64_t deal_num = header.first_deal + i;
+            const SolutionDb::Result res = db.lookup( deal_num, ms_deals );
+            ++local_counts[ static_cast< int >( res.status ) ];
+            if ( res.status != DealStatus::Solvable )
+            {
+                continue;
+            }
+
+            GameLog log;
+            log.seed = deal_num;
+            log.ms_deal = ms_deals;
+            start_game( log, st, hist );
+
+            size_t applied = 0;
+            while ( applied < res.num_moves && apply_record( res.moves[ applied ], st, hist ) )
+            {
+                ++applied;
+            }
+            if ( applied < res.num_moves || ! is_full_foundations( st ) )
+            {
+                if ( failed++ < 10 )
+                {
+                    fprintf( stderr, "Deal %" PRIu64 ": solution does not win\n", deal_num );
+                }
+            }
+        }
+
+        for ( int s = 0; s < 3; ++s )
+        {
+            counts[ s ] += local_counts[ s ];
+        }
+    };
+
+    std::vector< std::thread > threads;
+    for ( int i = 1; i < num_threads; ++i )
+    {
+        threads.emplace_back( worker, i );
+    }
+    worker( 0 );
+    for ( std::thread &t : threads )
+    {
+        t.join();
+    }
+
+    printf( "%s %" PRIu64 " to %" PRIu64 ": %" PRIu64 " solvable, %" PRIu64 " unsolvable, %" PRIu64 " unknown, %" PRIu64 " moves\n",
+            ms_deals ? "Deals" : "Seeds", header.first_deal, header.first_deal + header.num_deals - 1,
+            counts[ static_cast< int >( DealStatus::Solvable ) ].load(),
+            counts[ static_cast< int >( DealStatus::Unsolvable ) ].load(),
+            counts[ static_cast< int >( DealStatus::Unknown ) ].load(),
+            header.num_moves );
+
+    if ( failed )
+    {
+        printf( "%" PRIu64 " solutions do not win\n", failed.load() );
+        return 2;
+    }
+    return 0;
+}
+
+} // namespace
+
+int main( int argc, char* argv[] )
+{
+    using namespace std::literals;
+
+    std::vector< std::string > paths;
+    bool verify_only = false;
+    bool ms_deals = false;
+    int threads = std::max( 1u, std::thread::hardware_concurrency() );
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        if ( argv[ i ] == "--help"sv )
+        {
+            std::cerr << usage + 1;
+            return 0;
+        }
+        else if ( argv[ i ] == "--verify"sv )
+        {
+            verify_only = true;
+        }
+        else if ( argv[ i ] == "--ms-deals"sv )
+        {
+            ms_deals = true;
+        }
+        else if ( argv[ i ] == "--threads"sv )
+        {
+            if ( i + 1 >= argc || ( threads = atoi( argv[ i + 1 ] ) ) < 1 || threads > 1024 )
+            {
+                std::cerr << "--threads requires a value between 1 and 1024\n";
+                return 1;
+            }
+            ++i;
+        }
+        else if ( argv[ i ][ 0 ] == '-' )
+        {
+            std::cerr << "Unknown argument: " << argv[ i ] << "\n";
+            return 1;
+        }
+        else
+        {
+            paths.push_back( argv[ i ] );
+        }
+    }
+
+    if ( paths.size() != ( verify_only ? 1u : 2u ) )
+    {
+        std::cerr << usage + 1;
+        return 1;
+    }
+
+    if ( ! verify_only )
+    {
+        int res = build( paths[ 0 ], paths[ 1 ], ms_deals );
+        if ( res != 0 )
+        {
+            return res;
+        }
+    }
+    return verify( paths.back(), threads );
+}
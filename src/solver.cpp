@@ -0,0 +1,251 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "solver.h"
+
+#include "parallel_solver.h"
+
+#include <algorithm>
+
+namespace {
+
+// Weights of heuristic terms
+const int card_weight = 4;     // Each card not yet on foundations
+const int blocker_weight = 3;  // Each card sitting above a lower card of its cascade
+const int cell_weight = 2;     // Each occupied cell
+const int cascade_weight = 3;  // Each empty cascade (bonus)
+const int depth_weight = 1;    // Each move made so far
+
+// Expansions between checks of SolverOptions::cancel
+const uint64_t cancel_check_interval = 1024;
+
+} // namespace
+
+int heuristic( const GameState &st )
+{
+    int on_foundations = 0;
+    for ( CardCode c : st.foundations )
+    {
+        on_foundations += card_rank( c );
+    }
+
+    int blockers = 0;
+    int empty_cascades = 0;
+    for ( const Cascade &cascade : st.cascades )
+    {
+        empty_cascades += ( cascade.size == 0 );
+
+        int min_number = static_cast< int >( Number::King ) + 1;
+        for ( int i = 0; i < cascade.size; ++i )
+        {
+            int number = card_rank( cascade.m_cards[ i ] );
+            if ( number > min_number )
+            {
+                ++blockers;
+            }
+            min_number = std::min( min_number, number );
+        }
+    }
+
+    int used_cells = 0;
+    for ( CardCode c : st.cells )
+    {
+        used_cells += ( c != 0 );
+    }
+
+    return ( 52 - on_foundations ) * card_weight
+         + blockers * blocker_weight
+         + used_cells * cell_weight
+         - empty_cascades * cascade_weight;
+}
+
+Solver::Solver( const SolverOptions &opts )
+    : m_opts( opts )
+{
+    m_nodes.reserve( std::min< size_t >( m_opts.max_positions, 1 << 16 ) );
+    reset();
+}
+
+void Solver::reset()
+{
+    m_nodes.clear();
+    m_queue.clear();
+
+    const size_t initial_capacity = std::min< size_t >( m_opts.max_positions * 2, 1 << 12 );
+    if ( m_seen && m_seen->capacity() == initial_capacity )
+    {
+        m_seen->clear();
+    }
+    else
+    {
+        m_seen = std::make_unique< TranspositionTable >( initial_capacity );
+    }
+}
+
+void Solver::grow_seen()
+{
+    m_seen = std::make_unique< TranspositionTable >( std::min( m_opts.max_positions * 2, m_seen->capacity() * 4 ) );
+    for ( uint32_t idx = 0; idx < m_nodes.size(); ++idx )
+    {
+        m_seen->insert( m_nodes[ idx ].hash, idx );
+    }
+}
+
+std::vector< Move > with_auto_play( const GameState &start, const std::vector< Move > &chosen )
+{
+    GameState st = start;
+    MoveList forced;
+    std::vector< Move > moves;
+
+    auto add_forced = [ & ]
+    {
+        forced.size = 0;
+        auto_play( st, forced );
+        moves.insert( moves.end(), forced.begin(), forced.end() );
+    };
+
+    add_forced();
+    for ( const Move &m : chosen )
+    {
+        apply_move( st, m );
+        moves.push_back( m );
+        add_forced();
+    }
+
+    return moves;
+}
+
+SolveResult Solver::solve( const GameState &start )
+{
+    SolveResult res;
+
+    reset();
+
+    // Moves to foundations that are always safe are not worth searching, so
+    // every position is stored after auto play
+    GameState root = start;
+    MoveList forced;
+    auto_play( root, forced );
+
+    m_nodes.push_back( { pack( root ), root.hash, 0, 0, Move() } );
+    m_seen->insert( root.hash, 0 );
+    m_queue.push_back( { heuristic( root ), 0 } );
+
+    GameState st;
+    MoveList moves;
+    int32_t solved_node = -1;
+
+    while ( ! m_queue.empty() && solved_node < 0 )
+    {
+        std::pop_heap( m_queue.begin(), m_queue.end() );
+        uint32_t cur = m_queue.back().node;
+        m_queue.pop_back();
+
+        unpack( m_nodes[ cur ].state, st );
+        ++res.expanded;
+
+        if ( m_opts.cancel && res.expanded % cancel_check_interval == 0
+          && m_opts.cancel->load( std::memory_order_relaxed ) )
+        {
+            break;
+        }
+
+        generate_moves( st, moves );
+        for ( const Move &m : moves )
+        {
+            if ( m_nodes.size() >= m_opts.max_positions )
+            {
+                break;
+            }
+
+            apply_move( st, m );
+            forced.size = 0;
+            auto_play( st, forced );
+
+            uint32_t idx = m_nodes.size();
+            if ( m_seen->insert( st.hash, idx ) != TranspositionTable::InsertResult::Present )
+            {
+                m_nodes.push_back( { pack( st ), st.hash, cur, static_cast< uint16_t >( m_nodes[ cur ].depth + 1 ), m } );
+
+                if ( is_full_foundations( st ) )
+                {
+                    solved_node = idx;
+                }
+                else
+                {
+                    m_queue.push_back( { heuristic( st ) + m_nodes[ idx ].depth * depth_weight, idx } );
+                    std::push_heap( m_queue.begin(), m_queue.end() );
+                }
+            }
+
+            for ( int i = forced.size - 1; i >= 0; --i )
+            {
+                undo_move( st, forced.m_moves[ i ] );
+            }
+            undo_move( st, m );
+
+            if ( solved_node >= 0 )
+            {
+                break;
+            }
+        }
+
+        if ( m_nodes.size() >= m_opts.max_positions )
+        {
+            break;
+        }
+
+        if ( m_nodes.size() * 2 > m_seen->capacity() && m_seen->capacity() < m_opts.max_positions * 2 )
+        {
+            grow_seen();
+        }
+    }
+
+    res.generated = m_nodes.size();
+
+    if ( solved_node >= 0 )
+    {
+        res.status = SolveStatus::Solved;
+        for ( uint32_t idx = solved_node; idx != 0; idx = m_nodes[ idx ].parent )
+        {
+            res.moves.push_back( m_nodes[ idx ].move );
+        }
+        std::reverse( res.moves.begin(), res.moves.end() );
+        res.moves = with_auto_play( start, res.moves );
+    }
+    else if ( is_full_foundations( root ) )
+    {
+        res.status = SolveStatus::Solved;
+        res.moves = with_auto_play( start, res.moves );
+    }
+    else if ( m_queue.empty() && m_nodes.size() < m_opts.max_positions
+           && ! ( m_opts.cancel && m_opts.cancel->load( std::memory_order_relaxed ) ) )
+    {
+        res.status = SolveStatus::Unsolvable;
+    }
+
+    return res;
+}
+
+SolveResult solve( const GameState &start, const SolverOptions &opts )
+{
+    if ( opts.threads > 1 )
+    {
+        return ParallelSolver( opts ).solve( start );
+    }
+    return Solver( opts ).solve( start );
+}
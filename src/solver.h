@@ -0,0 +1,114 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "engine.h"
+#include "packed_state.h"
+#include "transposition_table.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+enum class SolveStatus
+{
+    Solved,
+    Unsolvable,   // Every reachable position was searched
+    LimitReached, // Gave up after storing max_positions, or was cancelled
+};
+
+struct SolverOptions
+{
+    // Bounds the memory used, roughly 100 bytes per position
+    size_t max_positions = 1000000;
+
+    // Threads searching a deal at once, see ParallelSolver. Solver itself
+    // always uses a single thread.
+    int threads = 1;
+
+    // When set, the search stops soon after this becomes true, as if the
+    // position limit was reached
+    const std::atomic< bool > *cancel = nullptr;
+};
+
+struct SolveResult
+{
+    SolveStatus status = SolveStatus::LimitReached;
+    std::vector< Move > moves;
+
+    uint64_t expanded = 0;  // Positions whose moves were generated
+    uint64_t generated = 0; // Distinct positions stored
+};
+
+// Estimated distance to a won game, lower is better
+int heuristic( const GameState &st );
+
+// Weighted best-first (A*) search. Keeps its buffers between searches, so
+// reusing one Solver for many deals avoids allocating for each of them.
+class Solver
+{
+public:
+    explicit Solver( const SolverOptions &opts = SolverOptions() );
+
+    SolveResult solve( const GameState &start );
+
+private:
+    struct Node
+    {
+        PackedState state;
+        uint64_t hash;
+        uint32_t parent;
+        uint16_t depth;
+        Move move;
+    };
+
+    struct QueueEntry
+    {
+        int priority;
+        uint32_t node;
+
+        bool operator<( const QueueEntry &ot ) const
+        {
+            // Lowest priority first, newest first among equals
+            return priority != ot.priority ? priority > ot.priority : node < ot.node;
+        }
+    };
+
+    void reset();
+    void grow_seen();
+
+    SolverOptions m_opts;
+    std::vector< Node > m_nodes;
+    std::vector< QueueEntry > m_queue; // Heap
+
+    // Positions already stored, including the ones equivalent to them by
+    // swapping cascades or cells. Starts small since most deals need few
+    // positions, and grows up to twice the position limit.
+    std::unique_ptr< TranspositionTable > m_seen;
+};
+
+// Solvers search positions after auto play (see auto_play()), and only keep
+// the moves they chose. This adds the auto played moves back to such a
+// solution of start.
+std::vector< Move > with_auto_play( const GameState &start, const std::vector< Move > &chosen );
+
+// Solves with a one-off Solver, or ParallelSolver if more than one thread is
+// requested
+SolveResult solve( const GameState &start, const SolverOptions &opts = SolverOptions() );
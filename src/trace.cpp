@@ -0,0 +1,116 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "trace.h"
+
+#ifdef FREECELL_TRACE
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+
+TraceBuffer trace_buffer;
+
+namespace {
+
+const char* level_name( int level )
+{
+    switch ( static_cast< TraceLevel >( level ) )
+    {
+    case TraceLevel::Error: return "error";
+    case TraceLevel::Info:  return "info";
+    case TraceLevel::Debug: return "debug";
+    }
+    return "?";
+}
+
+const char* event_name( int event )
+{
+    switch ( static_cast< TraceEvent >( event ) )
+    {
+    case TraceEvent::Input:        return "input";
+    case TraceEvent::Move:         return "move";
+    case TraceEvent::MoveRejected: return "move_rejected";
+    case TraceEvent::Undo:         return "undo";
+    case TraceEvent::Redo:         return "redo";
+    case TraceEvent::Frame:        return "frame";
+    case TraceEvent::Resize:       return "resize";
+    }
+    return "?";
+}
+
+} // namespace
+
+uint64_t trace_now()
+{
+    return std::chrono::duration_cast< std::chrono::nanoseconds >(
+        std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+void TraceBuffer::record( TraceLevel level, TraceEvent event, uint64_t a, uint64_t b )
+{
+    const uint64_t idx = m_next.fetch_add( 1, std::memory_order_relaxed );
+    Slot &slot = m_slots[ idx % capacity ];
+
+    slot.sequence.store( 2 * idx + 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+    slot.time_ns.store( trace_now(), std::memory_order_relaxed );
+    slot.a.store( a, std::memory_order_relaxed );
+    slot.b.store( b, std::memory_order_relaxed );
+    slot.kind.store( static_cast< int >( level ) << 8 | static_cast< int >( event ), std::memory_order_relaxed );
+    slot.sequence.store( 2 * idx + 2, std::memory_order_release );
+}
+
+bool TraceBuffer::dump( const std::string &path ) const
+{
+    FILE *out = std::fopen( path.c_str(), "w" );
+    if ( ! out )
+    {
+        return false;
+    }
+
+    const uint64_t end = m_next.load( std::memory_order_acquire );
+    const uint64_t begin = end - std::min( end, capacity );
+    uint64_t start_ns = 0;
+    for ( uint64_t idx = begin; idx < end; ++idx )
+    {
+        const Slot &slot = m_slots[ idx % capacity ];
+
+        if ( slot.sequence.load( std::memory_order_acquire ) != 2 * idx + 2 )
+        {
+            continue;
+        }
+        const uint64_t time_ns = slot.time_ns.load( std::memory_order_relaxed );
+        const uint64_t a = slot.a.load( std::memory_order_relaxed );
+        const uint64_t b = slot.b.load( std::memory_order_relaxed );
+        const int kind = slot.kind.load( std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_acquire );
+        if ( slot.sequence.load( std::memory_order_relaxed ) != 2 * idx + 2 )
+        {
+            continue; // Overwritten while reading
+        }
+
+        start_ns = ( start_ns ? start_ns : time_ns );
+        std::fprintf( out, "%12.3f %-5s %-13s %" PRIu64 " %" PRIu64 "\n",
+                      ( time_ns - start_ns ) / 1e6, level_name( kind >> 8 ), event_name( kind & 0xff ), a, b );
+    }
+
+    return std::fclose( out ) == 0;
+}
+
+#endif
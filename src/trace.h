@@ -0,0 +1,101 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+// Tracing of what the game does, into a ring buffer in memory that is written
+// out as text on request.
+//
+// Tracing is built in only when FREECELL_TRACE is defined to the most verbose
+// level to record, as in "make TRACE=3" (after "make clean"). Otherwise the
+// TRACE macros expand to nothing, and their arguments are not evaluated.
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+enum class TraceLevel : uint8_t
+{
+    Error = 1,
+    Info = 2,
+    Debug = 3,
+};
+
+enum class TraceEvent : uint8_t
+{
+    Input,        // a: key, modifiers << 8, mouse action << 16; b: char, or row << 16 | col
+    Move,         // a: encode_move(); b: moves in history after it
+    MoveRejected, // a: encode_move() of the move that was tried
+    Undo,         // b: moves in history after it
+    Redo,         // b: moves in history after it
+    Frame,        // a: nanoseconds to draw; b: bytes written
+    Resize,       // a: rows; b: columns
+};
+
+#ifdef FREECELL_TRACE
+
+// Records can be added from any thread without a lock. When full, the oldest
+// records are overwritten.
+class TraceBuffer
+{
+public:
+    static constexpr uint64_t capacity = 1 << 14;
+
+    void record( TraceLevel level, TraceEvent event, uint64_t a, uint64_t b );
+
+    // Writes the records in order, one per line. Records being written while
+    // dumping are left out. Returns false on error.
+    bool dump( const std::string &path ) const;
+
+private:
+    // Each field is atomic so that a slot can be read while it is written.
+    // The sequence is 2 * index + 1 while the record at index is written,
+    // and 2 * index + 2 once complete.
+    struct Slot
+    {
+        std::atomic< uint64_t > sequence{ 0 };
+        std::atomic< uint64_t > time_ns{ 0 };
+        std::atomic< uint64_t > a{ 0 };
+        std::atomic< uint64_t > b{ 0 };
+        std::atomic< uint16_t > kind{ 0 }; // Level << 8 | event
+    };
+
+    std::atomic< uint64_t > m_next{ 0 };
+    Slot m_slots[ capacity ];
+};
+
+extern TraceBuffer trace_buffer;
+
+uint64_t trace_now(); // Nanoseconds on the monotonic clock
+
+#define TRACE( level, event, a, b ) \
+    do { \
+        if constexpr ( static_cast< int >( TraceLevel::level ) <= FREECELL_TRACE ) \
+        { \
+            trace_buffer.record( TraceLevel::level, TraceEvent::event, ( a ), ( b ) ); \
+        } \
+    } while ( 0 )
+
+// Declares a variable holding the current time, for the duration of a TRACE
+#define TRACE_TIMESTAMP( name ) const uint64_t name = trace_now()
+
+#else
+
+#define TRACE( level, event, a, b ) do { } while ( 0 )
+#define TRACE_TIMESTAMP( name ) static_assert( true, "" )
+
+#endif
@@ -0,0 +1,146 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "transposition_table.h"
+
+#include <new>
+
+#include <sys/mman.h>
+
+TranspositionTable::TranspositionTable( size_t capacity )
+{
+    size_t size = 1;
+    while ( size < capacity )
+    {
+        size *= 2;
+    }
+
+    // Anonymous mappings are zero filled lazily, so a large table that is only
+    // partially used costs little to set up. Huge pages keep the number of
+    // page faults down, since entries are touched at random.
+    m_bytes = size * sizeof( Entry );
+    void *mem = mmap( nullptr, m_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if ( mem == MAP_FAILED )
+    {
+        throw std::bad_alloc();
+    }
+#ifdef MADV_HUGEPAGE
+    madvise( mem, m_bytes, MADV_HUGEPAGE );
+#endif
+
+    m_entries = static_cast< Entry* >( mem );
+    m_mask = size - 1;
+}
+
+TranspositionTable::~TranspositionTable()
+{
+    munmap( m_entries, m_bytes );
+}
+
+void TranspositionTable::clear()
+{
+    for ( size_t i = 0; i <= m_mask; ++i )
+    {
+        m_entries[ i ].key.store( 0, std::memory_order_relaxed );
+        m_entries[ i ].value.store( 0, std::memory_order_relaxed );
+    }
+}
+
+TranspositionTable::Entry* TranspositionTable::claim( uint64_t key, bool &claimed )
+{
+    key = stored_key( key );
+    claimed = false;
+
+    for ( int i = 0; i < probe_window; ++i )
+    {
+        Entry &e = m_entries[ ( key + i ) & m_mask ];
+
+        uint64_t cur = e.key.load( std::memory_order_acquire );
+        if ( cur == 0 )
+        {
+            if ( e.key.compare_exchange_strong( cur, key, std::memory_order_acq_rel ) )
+            {
+                claimed = true;
+                return &e;
+            }
+            // Lost the race, cur now holds the winner
+        }
+
+        if ( cur == key )
+        {
+            return &e;
+        }
+    }
+
+    return nullptr;
+}
+
+TranspositionTable::InsertResult TranspositionTable::insert( uint64_t key, uint64_t value )
+{
+    bool claimed;
+    Entry *e = claim( key, claimed );
+    if ( ! e )
+    {
+        return InsertResult::Full;
+    }
+
+    if ( ! claimed )
+    {
+        return InsertResult::Present;
+    }
+
+    e->value.store( value, std::memory_order_release );
+    return InsertResult::Inserted;
+}
+
+bool TranspositionTable::store( uint64_t key, uint64_t value )
+{
+    bool claimed;
+    Entry *e = claim( key, claimed );
+    if ( ! e )
+    {
+        return false;
+    }
+
+    e->value.store( value, std::memory_order_release );
+    return true;
+}
+
+bool TranspositionTable::find( uint64_t key, uint64_t &value ) const
+{
+    key = stored_key( key );
+
+    for ( int i = 0; i < probe_window; ++i )
+    {
+        const Entry &e = m_entries[ ( key + i ) & m_mask ];
+
+        uint64_t cur = e.key.load( std::memory_order_acquire );
+        if ( cur == key )
+        {
+            // A concurrent insert may not have published its value yet
+            value = e.value.load( std::memory_order_acquire );
+            return true;
+        }
+
+        if ( cur == 0 )
+        {
+            return false;
+        }
+    }
+
+    return false;
+}
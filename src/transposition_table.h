@@ -0,0 +1,78 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Fixed size hash table keyed by position hashes (see zobrist.h), storing a
+// 64 bit value per position. It never allocates after construction and can be
+// used from multiple threads concurrently without locking.
+//
+// Keys are placed with linear probing over a short window. When the window is
+// full the position is not stored, so callers must treat the table as a cache
+// that may forget, never as a complete record.
+class TranspositionTable
+{
+public:
+    enum class InsertResult
+    {
+        Inserted,
+        Present, // Key was already there, value is left unchanged
+        Full,    // No room in the probe window, nothing stored
+    };
+
+    // Capacity is rounded up to a power of two
+    explicit TranspositionTable( size_t capacity );
+    ~TranspositionTable();
+
+    TranspositionTable( const TranspositionTable& ) = delete;
+    TranspositionTable& operator=( const TranspositionTable& ) = delete;
+
+    InsertResult insert( uint64_t key, uint64_t value );
+
+    // Inserts the key if missing, and sets its value either way
+    bool store( uint64_t key, uint64_t value );
+
+    bool find( uint64_t key, uint64_t &value ) const;
+
+    // Not safe to call concurrently with other operations
+    void clear();
+
+    size_t capacity() const { return m_mask + 1; }
+
+private:
+    struct Entry
+    {
+        std::atomic< uint64_t > key;
+        std::atomic< uint64_t > value;
+    };
+
+    static const int probe_window = 8;
+
+    // Zero marks empty entries
+    static uint64_t stored_key( uint64_t key ) { return key ? key : 1; }
+
+    // Returns the entry holding key, claiming an empty one if needed
+    Entry* claim( uint64_t key, bool &claimed );
+
+    Entry *m_entries;
+    size_t m_bytes;
+    size_t m_mask;
+};
@@ -0,0 +1,62 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "zobrist.h"
+
+#include <algorithm>
+
+uint64_t zobrist_hash( const GameState &st )
+{
+    uint64_t h = 0;
+
+    for ( const Cascade &cascade : st.cascades )
+    {
+        uint8_t below = 0;
+        for ( int i = 0; i < cascade.size; ++i )
+        {
+            uint8_t card = key_index[ cascade.m_cards[ i ] ];
+            h ^= zobrist_keys.cascade[ card ][ below ];
+            below = card;
+        }
+    }
+
+    for ( CardCode c : st.cells )
+    {
+        if ( c )
+        {
+            h ^= zobrist_keys.cell[ key_index[ c ] ];
+        }
+    }
+
+    return h;
+}
+
+void canonicalize( GameState &st )
+{
+    // Empty ones go last, others are ordered by their bottom card
+    auto sort_key = []( CardCode c ) { return c ? c : 64; };
+
+    std::sort( st.cascades.begin(), st.cascades.end(), [ & ]( const Cascade &a, const Cascade &b )
+    {
+        return sort_key( a.size ? a.m_cards[ 0 ] : 0 ) < sort_key( b.size ? b.m_cards[ 0 ] : 0 );
+    });
+
+    std::sort( st.cells.begin(), st.cells.end(), [ & ]( CardCode a, CardCode b )
+    {
+        return sort_key( a ) < sort_key( b );
+    });
+}
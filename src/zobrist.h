@@ -0,0 +1,133 @@
+// Copyright 2019 Mustafa Serdar Sanli
+//
+// This file is part of Freecell for Terminal.
+//
+// Freecell for Terminal is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Freecell for Terminal is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Freecell for Terminal.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+// Position hashing that treats cascades and cells as unordered, since swapping
+// two cascades or two cells gives an equivalent position.
+//
+// Each card in a cascade contributes a key chosen by the card and the card
+// below it (or none, at the bottom). These pairs describe every cascade
+// completely, without saying which column it is in. Cards in cells contribute
+// a key of their own, and cards on foundations contribute nothing, as they
+// are implied by the rest.
+//
+// A move only changes what the moved card (the bottom one, for sequences)
+// sits on, so the hash is updated in O(1) by xoring the old and new key.
+
+#include "engine.h"
+
+#include <array>
+#include <cstdint>
+
+// Card codes leave gaps, so keys are indexed by 1-52 instead, to keep the
+// tables small enough to stay in cache. 0 is no card.
+constexpr std::array< uint8_t, 64 > make_key_index()
+{
+    std::array< uint8_t, 64 > index = {};
+    for ( int card = 0; card < 52; ++card )
+    {
+        index[ make_card( card / 13, card % 13 + 1 ) ] = card + 1;
+    }
+    return index;
+}
+
+inline constexpr std::array< uint8_t, 64 > key_index = make_key_index();
+
+struct ZobristKeys
+{
+    // Indexed by key_index of the card, then of the card below
+    std::array< std::array< uint64_t, 53 >, 53 > cascade = {};
+    std::array< uint64_t, 53 > cell = {};
+};
+
+constexpr uint64_t splitmix64( uint64_t &state )
+{
+    uint64_t z = ( state += 0x9E3779B97F4A7C15ull );
+    z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ull;
+    z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBull;
+    return z ^ ( z >> 31 );
+}
+
+constexpr ZobristKeys make_zobrist_keys()
+{
+    ZobristKeys keys;
+    uint64_t state = 0x5eed;
+    for ( int card = 1; card <= 52; ++card )
+    {
+        for ( int below = 0; below <= 52; ++below )
+        {
+            keys.cascade[ card ][ below ] = splitmix64( state );
+        }
+        keys.cell[ card ] = splitmix64( state );
+    }
+    return keys;
+}
+
+inline constexpr ZobristKeys zobrist_keys = make_zobrist_keys();
+
+// Computes hash from scratch
+uint64_t zobrist_hash( const GameState &st );
+
+// Value to xor into the hash of st to get the hash after applying m. Also
+// gives back the original hash when applied on the resulting state, since
+// undoing a move is symmetric.
+inline uint64_t move_hash_delta( const GameState &st, const Move &m )
+{
+    uint8_t card = 0;
+    uint64_t delta = 0;
+
+    switch ( m.from )
+    {
+    case Location::Cascade:
+    {
+        const Cascade &from = st.cascades[ m.from_idx ];
+        int pos = from.size - m.count;
+        card = key_index[ from.m_cards[ pos ] ];
+        delta ^= zobrist_keys.cascade[ card ][ pos ? key_index[ from.m_cards[ pos - 1 ] ] : 0 ];
+        break;
+    }
+    case Location::Cell:
+        card = key_index[ st.cells[ m.from_idx ] ];
+        delta ^= zobrist_keys.cell[ card ];
+        break;
+    case Location::Foundation:
+        card = key_index[ st.foundations[ m.from_idx ] ];
+        break;
+    }
+
+    switch ( m.to )
+    {
+    case Location::Cascade:
+    {
+        const Cascade &to = st.cascades[ m.to_idx ];
+        delta ^= zobrist_keys.cascade[ card ][ to.size ? key_index[ to.m_cards[ to.size - 1 ] ] : 0 ];
+        break;
+    }
+    case Location::Cell:
+        delta ^= zobrist_keys.cell[ card ];
+        break;
+    case Location::Foundation:
+        break;
+    }
+
+    return delta;
+}
+
+// Reorders cascades and cells into a canonical order, so that equivalent
+// positions become identical. Does not change the hash.
+void canonicalize( GameState &st );